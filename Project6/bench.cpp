@@ -0,0 +1,183 @@
+// Shayan Rasheed
+// CS 251 - Project 6
+// File Compression App
+// Decoder benchmark: compares the table decoder with the original
+// bit-by-bit tree walk on a generated text-like file, then reports what
+// limiting the code lengths costs on that file and on a skewed one, and
+// compares the Huffman, rANS and LZ77 codecs on all three files.
+//
+// Usage: ./bench.exe [size in MB]
+//
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include "bitstream.h"
+#include "util.h"
+
+using namespace std;
+
+//
+// makeTextFile
+// Writes size bytes of English-like words separated by spaces and
+// newlines, so the byte frequencies look like a real text file.
+//
+void makeTextFile(string filename, size_t size) {
+    const char* words[] = {"the", "of", "and", "to", "in", "is", "huffman",
+        "tree", "node", "encoding", "a", "compression", "frequency", "bit",
+        "map", "stream", "that", "for", "with", "file", "data", "code"};
+    const int nWords = sizeof(words) / sizeof(words[0]);
+    mt19937 gen(251);
+    string data;
+    data.reserve(size + 16);
+    while (data.size() < size) {
+        data += words[gen() % nWords];
+        data += (gen() % 12 == 0) ? '\n' : ' ';
+    }
+    data.resize(size);
+    ofstream out(filename, ios::binary);
+    out.write(data.data(), data.size());
+}
+
+//
+// makeSkewedFile
+// Writes size bytes where each letter is half as common as the one
+// before it, which gives the rarest letters very long Huffman codes.
+//
+void makeSkewedFile(string filename, size_t size) {
+    mt19937_64 gen(251);
+    string data(size, ' ');
+    for (size_t i = 0; i < size; i++) {
+        // trailing zeros of a random number: 0 half the time, 1 a quarter...
+        data[i] = 'a' + __builtin_ctzll(gen() | (1ULL << 40));
+    }
+    ofstream out(filename, ios::binary);
+    out.write(data.data(), data.size());
+}
+
+//
+// makeBiasedFile
+// Writes size bytes that are 'e' nine times out of ten and one of 15
+// other letters otherwise.  Huffman cannot spend less than a bit on the
+// 'e's, which is where rANS gains the most.
+//
+void makeBiasedFile(string filename, size_t size) {
+    mt19937 gen(251);
+    string data(size, 'e');
+    for (size_t i = 0; i < size; i++) {
+        if (gen() % 10 == 0) {
+            data[i] = 'f' + gen() % 15;
+        }
+    }
+    ofstream out(filename, ios::binary);
+    out.write(data.data(), data.size());
+}
+
+//
+// reportCodecs
+// Compresses and decompresses filename with each codec, and prints the
+// ratio, the throughput of each direction and whether the round trip
+// gave back the input.
+//
+void reportCodecs(string label, string filename) {
+    ifstream in(filename, ios::binary);
+    string original((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    cout << label << endl;
+    const int codecs[] = {HUFFMAN_VERSION, RANS_VERSION, LZ77_VERSION};
+    const char* names[] = {"Huffman", "rANS   ", "LZ77   "};
+    for (int c = 0; c < 3; c++) {
+        int codec = codecs[c];
+        HuffmanStats stats;
+        string decoded;
+        auto start = chrono::steady_clock::now();
+        compressFile(filename, filename + ".cmp", &stats, nullptr, 0, codec);
+        auto middle = chrono::steady_clock::now();
+        decompressFile(filename + ".cmp", "bench_out.txt", nullptr, &decoded);
+        auto end = chrono::steady_clock::now();
+        double mb = original.size() / 1e6;
+        cout << "  " << names[c] << ": "
+             << stats.outputBytes << " bytes, ratio "
+             << (double) stats.inputBytes / max(stats.outputBytes, 1LL) << ", compress "
+             << mb / chrono::duration<double>(middle - start).count() << " MB/s, decompress "
+             << mb / chrono::duration<double>(end - middle).count() << " MB/s"
+             << (decoded == original ? "" : "  ROUND TRIP FAILED") << endl;
+    }
+}
+
+//
+// reportLengthLimits
+// Prints the longest code and the encoded size of filename without a
+// length limit and with several limits, and how much bigger each limit
+// makes the output.
+//
+void reportLengthLimits(string label, string filename) {
+    long long counts[256];
+    countFile(filename, counts);
+    const int limits[] = {0, 15, 12, 11, 9};
+    long long unlimited = 0;
+    cout << label << endl;
+    for (int limit : limits) {
+        unsigned char lengths[NUM_SYMBOLS];
+        buildLengthsFromCounts(counts, lengths, limit);
+        long long bytes = (codeLengthBits(counts, lengths) + 7) / 8;
+        if (limit == 0) {
+            unlimited = bytes;
+        }
+        cout << "  limit " << (limit == 0 ? string("none") : to_string(limit))
+             << ": longest code " << (int) *max_element(lengths, lengths + NUM_SYMBOLS)
+             << ", " << bytes << " bytes, +"
+             << 100.0 * (bytes - unlimited) / max(unlimited, 1LL) << "%" << endl;
+    }
+}
+
+//
+// timeDecoder
+// Decompresses filename with the given decoder and returns the decoded
+// text, printing the throughput in MB/s.
+//
+string timeDecoder(string label, string filename,
+        string (*decoder)(ifbitstream&, const HuffmanTree&, ofstream&)) {
+    auto start = chrono::steady_clock::now();
+    ifbitstream input(filename);
+    HuffmanTree tree = readEncodingTree(input);
+    ofstream output("bench_out.txt", ios::binary);
+    string result = decoder(input, tree, output);
+    output.close();
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << label << ": " << result.size() / secs / 1e6 << " MB/s ("
+         << secs << " s)" << endl;
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    size_t megabytes = (argc > 1) ? atoi(argv[1]) : 4;
+    string filename = "bench_input.txt";
+
+    makeTextFile(filename, megabytes << 20);
+    compress(filename);
+
+    string fast = timeDecoder("table decode    ", filename + ".huf", decode);
+    string slow = timeDecoder("tree walk decode", filename + ".huf", decodeTreeWalk);
+
+    if (fast != slow) {
+        cout << "MISMATCH: decoders disagree" << endl;
+        return 1;
+    }
+    cout << "decoders agree on " << fast.size() << " bytes" << endl;
+
+    string skewed = "bench_skewed.txt";
+    makeSkewedFile(skewed, megabytes << 20);
+    reportLengthLimits("code length limits, text:", filename);
+    reportLengthLimits("code length limits, skewed:", skewed);
+
+    string biased = "bench_biased.txt";
+    makeBiasedFile(biased, megabytes << 20);
+    reportCodecs("codecs, text:", filename);
+    reportCodecs("codecs, skewed:", skewed);
+    reportCodecs("codecs, biased:", biased);
+    return 0;
+}
@@ -0,0 +1,120 @@
+// Shayan Rasheed
+// CS 251 - Project 6
+// File Compression App
+// Int hash map that many threads can add counts to at once.  The keys are
+// split over a power-of-two number of shards, each an ordinary hashmap
+// behind its own mutex, so threads adding different keys rarely wait on
+// each other.  Meant for parallel histograms: threads either add() each
+// key as they see it, or count into a private hashmap and addAll() it at
+// the end, which takes each shard's lock once per key instead.
+
+#pragma once
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include "hashmap.h"
+
+using namespace std;
+
+// Default # of shards
+const int CONCURRENT_SHARDS = 16;
+
+class concurrenthashmap {
+ private:
+    struct shard {
+      mutex lock;
+      hashmap map;
+      char padding[64];  // keeps neighbouring locks off one cache line
+    };
+
+    unique_ptr<shard[]> shards;
+    int nShards;  // a power of two
+
+    // Picks key's shard from the high bits of a multiplicative hash, so
+    // the shard does not follow the low bits the shard's map probes with
+    shard& shardOf(int key) const {
+      unsigned int h = (unsigned int) key * 0x9E3779B1u;
+      return shards[(h >> 16) & (nShards - 1)];
+    }
+
+ public:
+    explicit concurrenthashmap(int minShards = CONCURRENT_SHARDS) : nShards(1) {
+      while (nShards < minShards) {
+        nShards *= 2;
+      }
+      shards.reset(new shard[nShards]);
+    }
+
+    // The locks cannot be copied, and neither can the map
+    concurrenthashmap(const concurrenthashmap&) = delete;
+    concurrenthashmap& operator=(const concurrenthashmap&) = delete;
+
+    //
+    // add
+    // Adds delta to the value of key (a missing key counts as 0).  Safe to
+    // call from any number of threads.
+    //
+    void add(int key, int delta) {
+      shard& s = shardOf(key);
+      lock_guard<mutex> guard(s.lock);
+      s.map.add(key, delta);
+    }
+
+    //
+    // addAll
+    // Adds every value of counts to this map, e.g. one thread's private
+    // counts.  Safe to call from any number of threads.
+    //
+    void addAll(const hashmap& counts) {
+      counts.for_each([&](int key, int value) {
+        add(key, value);
+      });
+    }
+
+    //
+    // get
+    // Returns the value of key.  Throws runtime_error if key is not there.
+    //
+    int get(int key) const {
+      shard& s = shardOf(key);
+      lock_guard<mutex> guard(s.lock);
+      return s.map.get(key);
+    }
+
+    bool containsKey(int key) const {
+      shard& s = shardOf(key);
+      lock_guard<mutex> guard(s.lock);
+      return s.map.containsKey(key);
+    }
+
+    int size() const {
+      int total = 0;
+      for (int i = 0; i < nShards; i++) {
+        lock_guard<mutex> guard(shards[i].lock);
+        total += shards[i].map.size();
+      }
+      return total;
+    }
+
+    //
+    // copyTo
+    // Adds every pair to map in increasing key order, so the result (and
+    // the Huffman tree built from its keys() order) does not depend on
+    // which thread added a key first.  Call it once the adding is done.
+    //
+    void copyTo(hashmap& map) const {
+      vector<pair<int, int>> pairs;
+      for (int i = 0; i < nShards; i++) {
+        lock_guard<mutex> guard(shards[i].lock);
+        shards[i].map.for_each([&](int key, int value) {
+          pairs.push_back(make_pair(key, value));
+        });
+      }
+      sort(pairs.begin(), pairs.end());
+      map.reserve(map.size() + pairs.size());
+      for (const auto& p : pairs) {
+        map.add(p.first, p.second);
+      }
+    }
+};
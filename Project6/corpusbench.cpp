@@ -0,0 +1,219 @@
+// Shayan Rasheed
+// CS 251 - Project 6
+// File Compression App
+// Corpus benchmark: generates random, text-like, skewed and all-same-byte
+// files from 1 KB up to a maximum size, compresses and decompresses each
+// with every codec, and reports the ratio, header size, throughput and
+// peak memory of each run, checking that every file comes back intact.
+//
+// Each compress and decompress runs in its own child process, so the peak
+// RSS reported is that run's alone and not the largest seen so far.
+//
+// Usage: ./corpusbench.exe [max size, e.g. 64M or 1G] [huffman|rans|lz77]
+//
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <functional>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "bitstream.h"
+#include "util.h"
+
+using namespace std;
+
+// Each size is this many times the one before
+const int SIZE_STEP = 16;
+// Bytes generated and written at a time
+const size_t GENERATE_CHUNK = 1 << 20;
+
+// What a child process reports back about its run
+struct runResult {
+    bool ok;
+    double seconds;
+    HuffmanStats stats;
+    long peakKB;  // filled in by the parent from the child's rusage
+};
+
+//
+// generateFile
+// Writes size bytes of the given kind to filename, a chunk at a time so
+// that even the largest files never have to fit in memory.
+//
+void generateFile(string kind, string filename, size_t size) {
+    const char* words[] = {"the", "of", "and", "to", "in", "is", "huffman",
+        "tree", "node", "encoding", "a", "compression", "frequency", "bit",
+        "map", "stream", "that", "for", "with", "file", "data", "code"};
+    const int nWords = sizeof(words) / sizeof(words[0]);
+    mt19937_64 gen(251);
+    ofstream out(filename, ios::binary);
+    string chunk;
+    for (size_t written = 0; written < size; written += chunk.size()) {
+        size_t n = min(GENERATE_CHUNK, size - written);
+        chunk.clear();
+        if (kind == "random") {
+            while (chunk.size() < n) {
+                unsigned long long bytes = gen();
+                chunk.append((const char*) &bytes, 8);
+            }
+        } else if (kind == "text") {
+            while (chunk.size() < n) {
+                chunk += words[gen() % nWords];
+                chunk += (gen() % 12 == 0) ? '\n' : ' ';
+            }
+        } else if (kind == "skewed") {
+            // each letter half as common as the one before
+            while (chunk.size() < n) {
+                chunk += (char) ('a' + __builtin_ctzll(gen() | (1ULL << 40)));
+            }
+        } else {
+            chunk.assign(n, 'a');
+        }
+        chunk.resize(n);
+        out.write(chunk.data(), chunk.size());
+    }
+}
+
+//
+// runChild
+// Runs job in a child process and returns what it reported, with the
+// child's peak RSS.  The child sends its result back through a pipe.
+//
+runResult runChild(function<runResult()> job) {
+    runResult result = {false, 0, {0, 0, 0}, 0};
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return result;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        runResult child = job();
+        ssize_t sent = write(fds[1], &child, sizeof(child));
+        _exit(sent == (ssize_t) sizeof(child) ? 0 : 1);
+    }
+    close(fds[1]);
+    if (pid < 0 || read(fds[0], &result, sizeof(result)) != (ssize_t) sizeof(result)) {
+        result.ok = false;
+    }
+    close(fds[0]);
+    int status;
+    struct rusage usage;
+    if (pid > 0 && wait4(pid, &status, 0, &usage) == pid) {
+        result.peakKB = usage.ru_maxrss;
+    }
+    return result;
+}
+
+//
+// sameFiles
+// Returns true if the two files hold the same bytes.
+//
+bool sameFiles(string a, string b) {
+    mappedfile first(a);
+    mappedfile second(b);
+    return first.is_open() && second.is_open() && first.size() == second.size() &&
+           (first.size() == 0 || memcmp(first.data(), second.data(), first.size()) == 0);
+}
+
+string formatSize(size_t bytes) {
+    if (bytes >= (1 << 30)) {
+        return to_string(bytes >> 30) + "G";
+    }
+    if (bytes >= (1 << 20)) {
+        return to_string(bytes >> 20) + "M";
+    }
+    return to_string(bytes >> 10) + "K";
+}
+
+size_t parseSize(string text) {
+    size_t size = strtoull(text.c_str(), nullptr, 10);
+    char unit = text.empty() ? 'K' : toupper(text.back());
+    if (unit == 'G') {
+        return size << 30;
+    }
+    if (unit == 'M') {
+        return size << 20;
+    }
+    return size << 10;
+}
+
+//
+// benchmark
+// Generates one file, compresses and decompresses it with codec, prints
+// one row of the report, and removes the files.  Returns false if the
+// round trip fails.
+//
+bool benchmark(string kind, size_t size, string codecName, int codec) {
+    string input = "corpus_" + kind + "_" + formatSize(size) + ".bin";
+    string packed = input + ".cmp";
+    string output = input + ".out";
+    generateFile(kind, input, size);
+
+    runResult comp = runChild([&]() {
+        runResult r = {false, 0, {0, 0, 0}, 0};
+        auto start = chrono::steady_clock::now();
+        r.ok = compressFile(input, packed, &r.stats, nullptr, 0, codec);
+        r.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return r;
+    });
+    runResult decomp = runChild([&]() {
+        runResult r = {false, 0, {0, 0, 0}, 0};
+        auto start = chrono::steady_clock::now();
+        r.ok = decompressFile(packed, output, &r.stats);
+        r.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return r;
+    });
+    bool ok = comp.ok && decomp.ok && sameFiles(input, output);
+
+    double mb = size / 1e6;
+    cout << left << setw(7) << kind << right << setw(6) << formatSize(size) << "  "
+         << left << setw(8) << codecName << right << fixed << setprecision(3)
+         << setw(9) << (double) size / max(comp.stats.outputBytes, 1LL)
+         << setw(8) << comp.stats.headerBytes << setprecision(1)
+         << setw(10) << mb / max(comp.seconds, 1e-9)
+         << setw(10) << mb / max(decomp.seconds, 1e-9)
+         << setw(10) << comp.peakKB / 1024.0
+         << setw(10) << decomp.peakKB / 1024.0
+         << "  " << (ok ? "ok" : "FAILED") << endl;
+
+    remove(input.c_str());
+    remove(packed.c_str());
+    remove(output.c_str());
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    size_t maxSize = (argc > 1) ? parseSize(argv[1]) : (size_t) 64 << 20;
+    string only = (argc > 2) ? argv[2] : "";
+
+    const char* kinds[] = {"random", "text", "skewed", "same"};
+    const char* codecNames[] = {"huffman", "rans", "lz77"};
+    const int codecs[] = {HUFFMAN_VERSION, RANS_VERSION, LZ77_VERSION};
+
+    cout << left << setw(7) << "kind" << right << setw(6) << "size" << "  "
+         << left << setw(8) << "codec" << right << setw(9) << "ratio"
+         << setw(8) << "header" << setw(10) << "comp MB/s" << setw(10) << "dec MB/s"
+         << setw(10) << "comp RSS" << setw(10) << "dec RSS" << "  (RSS in MB)" << endl;
+    bool allOk = true;
+    for (size_t size = 1 << 10; size <= maxSize; size *= SIZE_STEP) {
+        for (const char* kind : kinds) {
+            for (int c = 0; c < 3; c++) {
+                if (only.empty() || only == codecNames[c]) {
+                    allOk = benchmark(kind, size, codecNames[c], codecs[c]) && allOk;
+                }
+            }
+        }
+    }
+    cout << (allOk ? "all round trips ok" : "ROUND TRIP FAILURES") << endl;
+    return allOk ? 0 : 1;
+}
@@ -0,0 +1,281 @@
+// Shayan Rasheed
+// CS 251 - Project 6
+// File Compression App
+// Generic hash map for any key and value type, laid out like Google's
+// SwissTable: one control byte per slot (EMPTY, or 7 bits of the key's
+// hash), so a lookup compares 16 control bytes at once (with SSE2 when
+// the compiler has it) and only looks at the keys whose 7 bits match.
+//
+// flathashmap<int, int> is the int hashmap from hashmap.h, so int maps
+// keep the key order the Huffman header depends on.
+
+#pragma once
+#include <vector>
+#include <string>
+#include <functional>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "hashmap.h"
+
+using namespace std;
+
+// # of control bytes compared at once
+const int FLAT_GROUP_SIZE = 16;
+
+//
+// flathashmap
+// Keys and values must be default constructible and copyable.  Like
+// hashmap there is no remove, so a slot is either EMPTY or full.
+//
+template <typename K, typename V, typename Hash = std::hash<K>>
+class flathashmap {
+ private:
+    static const signed char EMPTY = -128;  // 0x80; full slots are 0..127
+
+    vector<signed char> ctrl;  // capacity + FLAT_GROUP_SIZE bytes
+    vector<pair<K, V>> slots;  // capacity slots
+    size_t capacity;           // a power of two, at least FLAT_GROUP_SIZE
+    size_t nElems;
+    Hash hasher;
+
+    //
+    // mix
+    // Spreads the hash over all 64 bits: std::hash of an integer is the
+    // integer itself, which would put every small key in the same group.
+    //
+    static uint64_t mix(size_t h) {
+      uint64_t x = (uint64_t) h * 0x9E3779B97F4A7C15ULL;
+      return x ^ (x >> 32);
+    }
+
+    // Sets the control byte of slot i, and its copy past the end that lets
+    // a group read run over the end of the table without wrapping
+    void setCtrl(size_t i, signed char value) {
+      ctrl[i] = value;
+      if (i < (size_t) FLAT_GROUP_SIZE) {
+        ctrl[capacity + i] = value;
+      }
+    }
+
+    //
+    // matchGroup
+    // Returns a 16-bit mask with bit j set where the control byte at
+    // pos + j equals value.
+    //
+    unsigned int matchGroup(size_t pos, signed char value) const {
+#if defined(__SSE2__)
+      __m128i group = _mm_loadu_si128((const __m128i*) &ctrl[pos]);
+      return (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(value)));
+#else
+      unsigned int mask = 0;
+      for (int j = 0; j < FLAT_GROUP_SIZE; j++) {
+        if (ctrl[pos + j] == value) {
+          mask |= 1u << j;
+        }
+      }
+      return mask;
+#endif
+    }
+
+    //
+    // findSlot
+    // Returns the slot holding key, or the first empty slot on its probe
+    // sequence (where it would be inserted) with found set to false.
+    //
+    size_t findSlot(const K& key, uint64_t h, bool& found) const {
+      signed char tag = (signed char) (h & 0x7f);
+      size_t pos = (h >> 7) & (capacity - 1);
+      while (true) {
+        unsigned int match = matchGroup(pos, tag);
+        while (match != 0) {
+          size_t i = (pos + __builtin_ctz(match)) & (capacity - 1);
+          if (slots[i].first == key) {
+            found = true;
+            return i;
+          }
+          match &= match - 1;
+        }
+        unsigned int empty = matchGroup(pos, EMPTY);
+        if (empty != 0) {
+          found = false;
+          return (pos + __builtin_ctz(empty)) & (capacity - 1);
+        }
+        pos = (pos + FLAT_GROUP_SIZE) & (capacity - 1);
+      }
+    }
+
+    //
+    // rehash
+    // Moves every pair into a table with newCapacity slots.
+    //
+    void rehash(size_t newCapacity) {
+      vector<signed char> oldCtrl;
+      vector<pair<K, V>> oldSlots;
+      oldCtrl.swap(ctrl);
+      oldSlots.swap(slots);
+      size_t oldCapacity = capacity;
+
+      capacity = newCapacity;
+      ctrl.assign(capacity + FLAT_GROUP_SIZE, EMPTY);
+      slots.resize(capacity);
+      for (size_t i = 0; i < oldCapacity; i++) {
+        if (oldCtrl[i] != EMPTY) {
+          uint64_t h = mix(hasher(oldSlots[i].first));
+          bool found;
+          size_t j = findSlot(oldSlots[i].first, h, found);
+          setCtrl(j, (signed char) (h & 0x7f));
+          slots[j] = std::move(oldSlots[i]);
+        }
+      }
+    }
+
+ public:
+    flathashmap() : capacity(FLAT_GROUP_SIZE), nElems(0) {
+      ctrl.assign(capacity + FLAT_GROUP_SIZE, EMPTY);
+      slots.resize(capacity);
+    }
+
+    flathashmap(const flathashmap& other) = default;
+    flathashmap& operator=(const flathashmap& other) = default;
+
+    // A moved-from map is left empty and still usable.  The moves are
+    // noexcept, as hashmap's are, so a vector of maps moves them when it
+    // grows instead of copying; the only allocation is the one-group empty
+    // table the moved-from map gets.
+    flathashmap(flathashmap&& other) noexcept : flathashmap() {
+      swap(other);
+    }
+
+    flathashmap& operator=(flathashmap&& other) noexcept {
+      swap(other);
+      return *this;
+    }
+
+    void swap(flathashmap& other) noexcept {
+      ctrl.swap(other.ctrl);
+      slots.swap(other.slots);
+      std::swap(capacity, other.capacity);
+      std::swap(nElems, other.nElems);
+      std::swap(hasher, other.hasher);
+    }
+
+    //
+    // reserve
+    // Grows the table so n keys fit without another rehash.
+    //
+    void reserve(size_t n) {
+      size_t newCapacity = capacity;
+      while (n * 8 > newCapacity * 7) {
+        newCapacity *= 2;
+      }
+      if (newCapacity > capacity) {
+        rehash(newCapacity);
+      }
+    }
+
+    //
+    // clear
+    // Removes every key and keeps the table for reuse.
+    //
+    void clear() {
+      ctrl.assign(capacity + FLAT_GROUP_SIZE, EMPTY);
+      for (auto& slot : slots) {
+        slot = pair<K, V>();
+      }
+      nElems = 0;
+    }
+
+    //
+    // put
+    // Adds key with value, or replaces the value if key is already there.
+    //
+    void put(const K& key, const V& value) {
+      uint64_t h = mix(hasher(key));
+      bool found;
+      size_t i = findSlot(key, h, found);
+      if (found) {
+        slots[i].second = value;
+        return;
+      }
+      // keep the table at most 7/8 full
+      if ((nElems + 1) * 8 > capacity * 7) {
+        rehash(capacity * 2);
+        i = findSlot(key, h, found);
+      }
+      setCtrl(i, (signed char) (h & 0x7f));
+      slots[i].first = key;
+      slots[i].second = value;
+      nElems++;
+    }
+
+    //
+    // get
+    // Returns the value of key.  Throws runtime_error if key is not there.
+    //
+    V get(const K& key) const {
+      bool found;
+      size_t i = findSlot(key, mix(hasher(key)), found);
+      if (!found) {
+        throw runtime_error("invalid key");
+      }
+      return slots[i].second;
+    }
+
+    bool containsKey(const K& key) const {
+      bool found;
+      findSlot(key, mix(hasher(key)), found);
+      return found;
+    }
+
+    //
+    // keys
+    // Returns every key, in table order.
+    //
+    vector<K> keys() const {
+      vector<K> result;
+      result.reserve(nElems);
+      for (size_t i = 0; i < capacity; i++) {
+        if (ctrl[i] != EMPTY) {
+          result.push_back(slots[i].first);
+        }
+      }
+      return result;
+    }
+
+    //
+    // for_each
+    // Calls f(key, value) for every pair, in table order, like hashmap's.
+    //
+    template <typename F>
+    void for_each(F f) const {
+      for (size_t i = 0; i < capacity; i++) {
+        if (ctrl[i] != EMPTY) {
+          f(slots[i].first, slots[i].second);
+        }
+      }
+    }
+
+    int size() const {
+      return (int) nElems;
+    }
+};
+
+template <typename K, typename V, typename Hash>
+const signed char flathashmap<K, V, Hash>::EMPTY;
+
+//
+// int keys and values use hashmap itself, whose keys() order is part of
+// the original Huffman file header.  hashmap has its own hash function, so
+// only the default Hash is accepted rather than silently ignoring another.
+//
+template <typename Hash>
+class flathashmap<int, int, Hash> : public hashmap {
+    static_assert(is_same<Hash, std::hash<int>>::value,
+                  "flathashmap<int, int> always uses hashmap's own hash; "
+                  "use the default Hash");
+};
@@ -0,0 +1,374 @@
+// Shayan Rasheed
+// CS 251 - Project 6
+// File Compression App
+// Hash map benchmark: times inserts, lookups of present keys and lookups
+// of missing keys for flathashmap, the int hashmap and std::unordered_map,
+// with 64-bit integer keys and with string keys, then times counting keys
+// from several threads into concurrenthashmap.  Last it checks that the
+// int hashmap's text and binary forms read back what was written (and
+// reject damaged input), and times reading a 257-entry frequency map with
+// the original text parser, the current one and the binary form.
+//
+// Usage: ./hashbench.exe [# of keys] [# of threads]
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <unordered_map>
+#include <thread>
+#include <functional>
+#include <sstream>
+#include <climits>
+#include "hashmap.h"
+#include "flathashmap.h"
+#include "concurrenthashmap.h"
+
+using namespace std;
+
+// Keeps the compiler from dropping lookups whose results are not used
+volatile long long sink;
+
+double nsPerOp(chrono::steady_clock::time_point start, size_t ops) {
+    return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / ops;
+}
+
+//
+// timeMap
+// Inserts every key of present, then looks up every key of present and
+// of missing, and prints the ns per operation of each phase.  MapT needs
+// put(), containsKey() and get().
+//
+template <typename MapT, typename K>
+void timeMap(string label, const vector<K>& present, const vector<K>& missing) {
+    MapT map;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < present.size(); i++) {
+        map.put(present[i], (int) i);
+    }
+    double insert = nsPerOp(start, present.size());
+
+    start = chrono::steady_clock::now();
+    long long sum = 0;
+    for (const K& key : present) {
+        sum += map.get(key);
+    }
+    double hit = nsPerOp(start, present.size());
+
+    start = chrono::steady_clock::now();
+    for (const K& key : missing) {
+        sum += map.containsKey(key);
+    }
+    double miss = nsPerOp(start, missing.size());
+    sink = sum;
+
+    cout << label << ": insert " << insert << " ns, hit " << hit
+         << " ns, miss " << miss << " ns" << endl;
+}
+
+//
+// stdmap
+// std::unordered_map with the same put/get/containsKey calls.
+//
+template <typename K>
+class stdmap {
+ private:
+    unordered_map<K, int> map;
+ public:
+    void put(const K& key, int value) {
+        map[key] = value;
+    }
+    int get(const K& key) const {
+        return map.at(key);
+    }
+    bool containsKey(const K& key) const {
+        return map.count(key) != 0;
+    }
+};
+
+//
+// timeCounting
+// Counts how often each value of keys occurs: with one thread and a
+// hashmap, with nThreads threads adding straight into a concurrenthashmap,
+// and with nThreads threads each counting into a private hashmap that is
+// merged at the end.  Prints the ns per key of each and checks that they
+// agree.
+//
+void timeCounting(const vector<int>& keys, int nThreads) {
+    auto start = chrono::steady_clock::now();
+    hashmap single;
+    for (int key : keys) {
+        single.add(key, 1);
+    }
+    double serial = nsPerOp(start, keys.size());
+
+    // Runs body(begin, end) on nThreads slices of keys
+    auto runThreads = [&](function<void(size_t, size_t)> body) {
+        vector<thread> threads;
+        for (int t = 0; t < nThreads; t++) {
+            threads.emplace_back(body, keys.size() / nThreads * t,
+                t == nThreads - 1 ? keys.size() : keys.size() / nThreads * (t + 1));
+        }
+        for (auto& th : threads) {
+            th.join();
+        }
+    };
+
+    start = chrono::steady_clock::now();
+    concurrenthashmap shared;
+    runThreads([&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            shared.add(keys[i], 1);
+        }
+    });
+    double direct = nsPerOp(start, keys.size());
+
+    start = chrono::steady_clock::now();
+    concurrenthashmap merged;
+    runThreads([&](size_t begin, size_t end) {
+        hashmap local;
+        for (size_t i = begin; i < end; i++) {
+            local.add(keys[i], 1);
+        }
+        merged.addAll(local);
+    });
+    double perThread = nsPerOp(start, keys.size());
+
+    hashmap a, b;
+    shared.copyTo(a);
+    merged.copyTo(b);
+    bool agree = a.size() == single.size() && b.size() == single.size();
+    single.for_each([&](int key, int value) {
+        agree = agree && a.get(key) == value && b.get(key) == value;
+    });
+
+    cout << "counting " << keys.size() << " keys (" << single.size() << " distinct): "
+         << "1 thread " << serial << " ns, " << nThreads << " threads shared "
+         << direct << " ns, " << nThreads << " threads merged " << perThread
+         << " ns" << (agree ? "" : "  MISMATCH") << endl;
+}
+
+//
+// originalParse
+// The original operator>>, which built a string per pair and called stoi,
+// kept only to time the current parser against.
+//
+void originalParse(istream &in, hashmap &myMap) {
+    bool done = false;
+    in.get();
+    int nextChar = in.get();
+    while (!done) {
+        string nextInput;
+        while (nextChar != ',' && nextChar != '}') {
+            nextInput += nextChar;
+            nextChar = in.get();
+        }
+        if (nextChar == ',') {
+            in.get();
+            nextChar = in.get();
+        } else {
+            done = true;
+        }
+        if (nextInput != "") {
+            size_t pos = nextInput.find(":");
+            myMap.put(stoi(nextInput.substr(0, pos)),
+                      stoi(nextInput.substr(pos + 1, nextInput.length() - 1)));
+        }
+    }
+}
+
+// Returns true if a and b hold the same pairs in the same keys() order
+bool sameMap(const hashmap& a, const hashmap& b) {
+    if (a.keys() != b.keys()) {
+        return false;
+    }
+    bool same = true;
+    a.for_each([&](int key, int value) {
+        same = same && b.get(key) == value;
+    });
+    return same;
+}
+
+// A frequency map like a Huffman header's: every byte and PSEUDO_EOF
+hashmap frequencyLikeMap() {
+    hashmap map;
+    for (int b = -128; b < 128; b++) {
+        map.put(b, (b + 128) * 997 + 1);
+    }
+    map.put(256, 1);
+    return map;
+}
+
+//
+// checkSerialize
+// Writes maps with << and serialize and reads them back with >> and
+// deserialize: an empty map, negative keys and values, and a 257-entry
+// map.  Then feeds both readers damaged input, which must set failbit.
+// Prints each failure and returns false if there was one.
+//
+bool checkSerialize() {
+    bool ok = true;
+    auto fail = [&](string what) {
+        cout << "serialize check failed: " << what << endl;
+        ok = false;
+    };
+
+    hashmap empty, negative;
+    negative.put(-1, -2);
+    negative.put(INT_MIN, INT_MAX);
+    negative.put(INT_MAX, INT_MIN);
+    negative.put(0, -300);
+    hashmap large = frequencyLikeMap();
+    vector<pair<string, hashmap*>> maps = {
+        {"empty", &empty}, {"negative", &negative}, {"257 entries", &large}};
+
+    for (auto& m : maps) {
+        ostringstream text, binary;
+        text << *m.second;
+        m.second->serialize(binary);
+
+        hashmap fromText, fromBinary;
+        istringstream textIn(text.str()), binaryIn(binary.str());
+        textIn >> fromText;
+        if (textIn.fail() || !sameMap(*m.second, fromText)) {
+            fail(m.first + " map, text form");
+        }
+        if (!fromBinary.deserialize(binaryIn) || !sameMap(*m.second, fromBinary)) {
+            fail(m.first + " map, binary form");
+        }
+
+        // every shorter prefix of the binary form is cut short
+        string whole = binary.str();
+        for (size_t n = 0; n < whole.size(); n++) {
+            hashmap partial;
+            istringstream in(whole.substr(0, n));
+            if (partial.deserialize(in) || !in.fail()) {
+                fail(m.first + " map, binary form cut to " + to_string(n) + " bytes");
+                break;
+            }
+        }
+    }
+
+    // text the parser must reject: each of operator>>'s failbit paths
+    const char* malformed[] = {
+        "",                 // no '{'
+        "1:2}",             // no '{'
+        "{",                // ends before a key
+        "{x:2}",            // key is not a number
+        "{-:2}",            // just a sign
+        "{1 2}",            // no ':'
+        "{1:}",             // no value
+        "{1:2",             // ends after a value
+        "{1:2;3:4}",        // bad separator
+        "{1:2, }",          // separator with no pair after it
+        "{2147483648:1}",   // key too large for an int
+        "{1:-2147483649}",  // value too small for an int
+    };
+    for (const char* text : malformed) {
+        hashmap map;
+        istringstream in(text);
+        in >> map;
+        if (!in.fail()) {
+            fail(string("text form accepted \"") + text + "\"");
+        }
+    }
+
+    // binary input the reader must reject
+    const string badBinary[] = {
+        string("\x02\x00", 2),       // unknown version
+        string("\x01\x01\x80", 3),   // varint cut short
+        string("\x01\x01\x02\xfe\xff\xff\xff\x7f", 8),  // value over 32 bits
+    };
+    for (const string& data : badBinary) {
+        hashmap map;
+        istringstream in(data);
+        if (map.deserialize(in) || !in.fail()) {
+            fail("binary form accepted bad data");
+        }
+    }
+
+    if (ok) {
+        cout << "serialize checks passed" << endl;
+    }
+    return ok;
+}
+
+//
+// timeSerialize
+// Reads a 257-entry frequency map reps times with the original text
+// parser, the current operator>> and deserialize, and prints the us per
+// read of each.
+//
+void timeSerialize(int reps) {
+    hashmap map = frequencyLikeMap();
+    ostringstream text, binary;
+    text << map;
+    map.serialize(binary);
+
+    // Runs read on a fresh stream and map reps times; returns us per read
+    auto timeReads = [&](const string& data, function<void(istream&, hashmap&)> read) {
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < reps; i++) {
+            istringstream in(data);
+            hashmap result;
+            read(in, result);
+            sink = result.size();
+        }
+        return nsPerOp(start, reps) / 1000;
+    };
+    double original = timeReads(text.str(), [](istream& in, hashmap& m) {
+        originalParse(in, m);
+    });
+    double current = timeReads(text.str(), [](istream& in, hashmap& m) {
+        in >> m;
+    });
+    double fromBinary = timeReads(binary.str(), [](istream& in, hashmap& m) {
+        m.deserialize(in);
+    });
+
+    cout << "reading a 257-entry map (" << text.str().size() << " bytes as text, "
+         << binary.str().size() << " binary): original text parser " << original
+         << " us, text parser " << current << " us, binary " << fromBinary << " us" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = (argc > 1) ? atoi(argv[1]) : 1000000;
+    int nThreads = (argc > 2) ? atoi(argv[2]) : 4;
+    mt19937_64 gen(251);
+
+    // The int hashmap only takes ints, so its keys fit in 31 bits
+    vector<long long> present(n), missing(n);
+    for (size_t i = 0; i < n; i++) {
+        present[i] = (long long) (gen() >> 34) * 2;
+        missing[i] = present[i] + 1;
+    }
+    vector<int> presentInt(present.begin(), present.end());
+    vector<int> missingInt(missing.begin(), missing.end());
+
+    vector<string> presentStr(n), missingStr(n);
+    for (size_t i = 0; i < n; i++) {
+        presentStr[i] = "key-" + to_string(present[i]);
+        missingStr[i] = "key-" + to_string(missing[i]);
+    }
+
+    cout << n << " keys" << endl;
+    timeMap<hashmap>("hashmap (int)                ", presentInt, missingInt);
+    timeMap<flathashmap<long long, int>>("flathashmap<long long, int>  ", present, missing);
+    timeMap<stdmap<long long>>("unordered_map<long long, int>", present, missing);
+    timeMap<flathashmap<string, int>>("flathashmap<string, int>     ", presentStr, missingStr);
+    timeMap<stdmap<string>>("unordered_map<string, int>   ", presentStr, missingStr);
+
+    // Skewed keys, like the symbols of a text, from a few thousand values
+    vector<int> counted(n * 4);
+    for (size_t i = 0; i < counted.size(); i++) {
+        counted[i] = (int) (gen() % 4096) & (int) (gen() % 4096);
+    }
+    timeCounting(counted, max(nThreads, 1));
+
+    bool ok = checkSerialize();
+    timeSerialize(20000);
+    return ok ? 0 : 1;
+}
@@ -3,128 +3,212 @@
 //
 // TODO:  Write your own header and fill in all functions marked TODO below.
 //
+// The map uses open addressing: the pairs are stored in one vector in the
+// order they were added, and a power-of-two table of slots holds the
+// index of each pair at its hash position (linear probing).  The slot
+// table doubles whenever it is more than half full, so a lookup touches a
+// couple of slots no matter how many keys there are, and no pair has its
+// own heap allocation.  The slot table is only allocated by the first put,
+// so empty and moved-from maps own no memory.
+//
+// Each pair also links to the next pair of its bucket in the original
+// 10-bucket chained map, so iterating walks the pairs in that map's order
+// (see keys()) without sorting or copying them.
+//
 
 #include "hashmap.h"
+#include "varint.h"
 #include <vector>
+#include <climits>
 using namespace std;
 
+const int hashmap::EMPTY_SLOT;
+const int hashmap::LEGACY_BUCKETS;
+const int hashmap::BINARY_VERSION;
+
+// # of slots the first put allocates
+static const int INITIAL_SLOTS = 16;
+
 //
-// This constructor chooses number of buckets, initializes size of map to 0, and
-// creates a bucket array with nBuckets number of pointers to linked lists.
+// This constructor creates an empty map.
 //
 hashmap::hashmap() {
-    this->nBuckets=10;
-    this->nElems=0;
-    this->buckets=createBucketArray(nBuckets);
+  resetBuckets();
 }
 
 //
-// Given a number of buckets, creates a hashtable (array of linked list heads).
-// @param nBuckets the number of buckets you want in the hashtable.
-// return an array of heads of linked lists of key_val_pairs
+// This method empties the legacy bucket lists.
 //
-hashmap::bucketArray hashmap::createBucketArray(int nBuckets) {
-    bucketArray newBuckets = new key_val_pair*[nBuckets];
-    for (int i = 0; i < nBuckets; i++) {
-        newBuckets[i] = nullptr;
-    }
-    return newBuckets;
+void hashmap::resetBuckets() {
+  for (int b = 0; b < LEGACY_BUCKETS; b++) {
+    bucketHead[b] = -1;
+    bucketTail[b] = -1;
+  }
 }
 
 //
-// This destructor frees memory for all elements of buckets & also all elements
-// of linked lists that those bucket pointers may point to.
+// Nothing to free: the vectors release their own storage.
 //
 hashmap::~hashmap() {
-    for (int i=0; i < nBuckets; i++){
-        key_val_pair *front =  buckets[i];
-        while (front != nullptr) {
-            key_val_pair *temp = front->next;
-            delete front;
-            front = temp;
-        }
+}
+
+//
+// This method returns the slot holding key, or the free slot where key
+// would go.  The table is never full, so the probe always ends.  Must not
+// be called before the table is allocated.
+//
+int hashmap::findSlot(int key, int hash) const {
+  int mask = slots.size() - 1;
+  int index = hash & mask;
+  while (slots[index] != EMPTY_SLOT && entries[slots[index]].key != key) {
+    index = (index + 1) & mask;
+  }
+  return index;
+}
+
+//
+// This method replaces the slot table with one of nSlots slots (a power of
+// two) and puts every pair back in it.
+//
+void hashmap::rehash(size_t nSlots) {
+  slots.assign(nSlots, EMPTY_SLOT);
+  int mask = slots.size() - 1;
+  for (size_t i = 0; i < entries.size(); i++) {
+    int index = entries[i].hash & mask;
+    while (slots[index] != EMPTY_SLOT) {
+      index = (index + 1) & mask;
     }
-    delete[] buckets;
-    
+    slots[index] = i;
+  }
 }
 
 //
-// This method puts key/value pair in the map.  It checks to see if key is
-// already in map while traversing the list to find the end of it.
+// This method puts key/value pair in the map.  If key is already in the
+// map, its value is replaced.
 //
 void hashmap::put(int key, int value) {
-  key_val_pair* newPair = new key_val_pair;
-  newPair->key = key;
-  newPair->value = value;
-  newPair->next = nullptr;
-  
-  int index = hashFunction(key) % nBuckets;
-  key_val_pair* cur = buckets[index];
-  key_val_pair* prev = nullptr;
-  
-  while(cur != nullptr) {
-    prev = cur;
-    if(cur->key == key) {
-      cur->value = value;
-      delete newPair;
-      return;
-    }
-    cur = cur->next;
+  if (slots.empty()) {
+    slots.assign(INITIAL_SLOTS, EMPTY_SLOT);
+  }
+  int hash = hashFunction(key);
+  int index = findSlot(key, hash);
+  if (slots[index] != EMPTY_SLOT) {
+    entries[slots[index]].value = value;
+    return;
+  }
+  insertAt(index, key, value, hash);
+}
+
+//
+// This method adds delta to the value of key, putting key in the map with
+// value delta if it is not there yet.  It hashes and probes once, where
+// containsKey, get and put would each do it again.
+//
+void hashmap::add(int key, int delta) {
+  if (slots.empty()) {
+    slots.assign(INITIAL_SLOTS, EMPTY_SLOT);
   }
-  
-  if(prev == nullptr) {
-    buckets[index] = newPair;
+  int hash = hashFunction(key);
+  int index = findSlot(key, hash);
+  if (slots[index] != EMPTY_SLOT) {
+    entries[slots[index]].value += delta;
+    return;
+  }
+  insertAt(index, key, delta, hash);
+}
+
+//
+// This method adds a new pair in the free slot at index, which findSlot
+// returned for key.
+//
+void hashmap::insertAt(int index, int key, int value, int hash) {
+  key_val_pair newPair;
+  newPair.key = key;
+  newPair.value = value;
+  newPair.hash = hash;
+  newPair.next = -1;
+  int i = entries.size();
+  slots[index] = i;
+  entries.push_back(newPair);
+
+  // append the pair to its legacy bucket's list (hashFunction returns
+  // INT_MIN for some keys, which abs cannot make positive)
+  int bucket = (unsigned int) hash % LEGACY_BUCKETS;
+  if (bucketTail[bucket] == -1) {
+    bucketHead[bucket] = i;
   } else {
-    prev->next = newPair;
+    entries[bucketTail[bucket]].next = i;
+  }
+  bucketTail[bucket] = i;
+
+  // keep the table at most half full
+  if (entries.size() * 2 > slots.size()) {
+    rehash(slots.size() * 2);
   }
-  nElems++;
 }
 
 //
 // This method returns the value associated with key.
 //
 int hashmap::get(int key) const {
-  int index = hashFunction(key) % nBuckets;
-  key_val_pair* cur = buckets[index];
-  while(cur != nullptr) {
-    if(cur->key == key) {
-      return cur->value;
-    }
-    cur = cur->next;
+  if (entries.empty()) {
+    throw runtime_error("invalid key");
   }
-  throw runtime_error("invalid key");
+  int index = findSlot(key, hashFunction(key));
+  if (slots[index] == EMPTY_SLOT) {
+    throw runtime_error("invalid key");
+  }
+  return entries[slots[index]].value;
 }
 
 //
 // This function checks if the key is already in the map.
 //
 bool hashmap::containsKey(int key) {
-  int index = hashFunction(key) % nBuckets;
-  key_val_pair* cur = buckets[index];
-  while(cur != nullptr) {
-    if(cur->key == key) {
-      return true;
-    }
-    cur = cur->next;
-  }
-  return false;
+  return !entries.empty() && slots[findSlot(key, hashFunction(key))] != EMPTY_SLOT;
 }
 
 //
-// This method goes through all buckets and adds all keys to a vector.
+// This method returns all keys in the order the original 10-bucket chained
+// map listed them: by hashFunction(key) % 10, then by insertion order.
+// Huffman trees are built in keys() order, so files written with the
+// chained map still decode to the same tree.  Iterating the map (or
+// for_each) visits the pairs in this same order without the copy.
 //
 vector<int> hashmap::keys() const {
   vector<int> keys;
-  for (int i=0; i < nBuckets; i++){
-        key_val_pair *front =  buckets[i];
-        while (front != nullptr) {
-            keys.push_back(front->key);
-            front = front->next;
-        }
-    }
+  keys.reserve(entries.size());
+  for (const key_val_pair &pair : *this) {
+    keys.push_back(pair.key);
+  }
   return keys;
 }
 
+//
+// This constructor starts at the first pair of bucket or a later one.
+//
+hashmap::const_iterator::const_iterator(const hashmap *map, int bucket)
+    : map(map), bucket(bucket), index(-1) {
+  while (this->bucket < LEGACY_BUCKETS && map->bucketHead[this->bucket] == -1) {
+    this->bucket++;
+  }
+  if (this->bucket < LEGACY_BUCKETS) {
+    index = map->bucketHead[this->bucket];
+  }
+}
+
+//
+// This operator moves to the next pair of the bucket, or to the first pair
+// of the next non-empty bucket.
+//
+hashmap::const_iterator& hashmap::const_iterator::operator++() {
+  index = map->entries[index].next;
+  if (index == -1) {
+    *this = const_iterator(map, bucket + 1);
+  }
+  return *this;
+}
+
 //
 // The hash function for hashmap implementation.
 // For an extension, you might want to improve this function.
@@ -136,14 +220,15 @@ int hashmap::hashFunction(int input) const {
     // use unsigned integers for calculation
     // we are also using so-called "magic numbers"
     // see https://stackoverflow.com/a/12996028/561677 for details
-    unsigned int temp = ((input >> 16) ^ input) * 0x45d9f3b;
+    unsigned int temp = (unsigned int) ((input >> 16) ^ input) * 0x45d9f3b;
     temp = (temp >> 16) ^ temp;
 
     // convert back to positive signed int
     // (note: this ignores half the possible hashes!)
     int hash = (int) temp;
     if (hash < 0) {
-        hash *= -1;
+        // negate in unsigned: INT_MIN has no positive and stays INT_MIN
+        hash = (int) (0u - temp);
     }
 
     return hash;
@@ -153,116 +238,230 @@ int hashmap::hashFunction(int input) const {
 // This function returns the number of elements in the hashmap.
 //
 int hashmap::size() {
-    return nElems;
+    return entries.size();
 }
 
 //
 // Copy constructor
 //
 hashmap::hashmap(const hashmap &myMap) {
-    // make a deep copy of the map
-    nBuckets = myMap.nBuckets;
-
-    buckets = createBucketArray(nBuckets);
-
-    // walk through the old array and add all elements to this one
-    vector<int> keys = myMap.keys();
-    for (size_t i=0; i < keys.size(); i++) {
-        int key = keys[i];
-        int value = myMap.get(key);
-        put(key,value);
-    }
-
+    // the pairs and slots are plain values, so copying them copies the map
+    entries = myMap.entries;
+    slots = myMap.slots;
+    copyBuckets(myMap);
 }
 
 //
 // Equals operator.
 //
 hashmap& hashmap::operator= (const hashmap &myMap) {
-    // make a deep copy of the map
-
     // watch for self-assignment
     if (this == &myMap) {
         return *this;
     }
 
-    // if data exists in the map, delete it
-    for (int i=0; i < nBuckets; i++) {
-        hashmap::key_val_pair* bucket = buckets[i];
-        while (bucket != nullptr) {
-            // walk the linked list and delete each node
-            hashmap::key_val_pair* temp = bucket;
-            bucket = bucket->next;
-            delete temp;
-        }
-        buckets[i] = nullptr;
-    }
-    nElems = 0;
-    // walk through the old array and add all elements to this one
-    vector<int> keys = myMap.keys();
-    for (size_t i=0; i < keys.size(); i++) {
-        int key = keys[i];
-        int value = myMap.get(key);
-        put(key,value);
-    }
+    // vector assignment copies into the storage this map already has when
+    // it is big enough, so no memory is freed or allocated in that case
+    entries = myMap.entries;
+    slots = myMap.slots;
+    copyBuckets(myMap);
 
     // return the existing object so we can chain this operator
     return *this;
 }
 
+//
+// Move constructor: takes myMap's storage and leaves myMap empty.
+//
+hashmap::hashmap(hashmap &&myMap) noexcept
+    : entries(std::move(myMap.entries)), slots(std::move(myMap.slots)) {
+    copyBuckets(myMap);
+    myMap.entries.clear();
+    myMap.slots.clear();
+    myMap.resetBuckets();
+}
+
+//
+// Move operator: swaps storage with myMap, which then frees this map's old
+// storage when it is destroyed.
+//
+hashmap& hashmap::operator= (hashmap &&myMap) noexcept {
+    swap(myMap);
+    return *this;
+}
+
+//
+// This method exchanges the contents of two maps in O(1).
+//
+void hashmap::swap(hashmap &myMap) noexcept {
+    entries.swap(myMap.entries);
+    slots.swap(myMap.slots);
+    for (int b = 0; b < LEGACY_BUCKETS; b++) {
+        std::swap(bucketHead[b], myMap.bucketHead[b]);
+        std::swap(bucketTail[b], myMap.bucketTail[b]);
+    }
+}
+
+//
+// This method copies myMap's legacy bucket lists, which index into the
+// pairs just copied from it.
+//
+void hashmap::copyBuckets(const hashmap &myMap) {
+    for (int b = 0; b < LEGACY_BUCKETS; b++) {
+        bucketHead[b] = myMap.bucketHead[b];
+        bucketTail[b] = myMap.bucketTail[b];
+    }
+}
+
+//
+// This method makes room for n keys: the pair vector is reserved and the
+// slot table grown to stay at most half full with n keys.
+//
+void hashmap::reserve(int n) {
+    if (n <= 0) {
+        return;
+    }
+    entries.reserve(n);
+    size_t nSlots = INITIAL_SLOTS;
+    while (nSlots < (size_t) n * 2) {
+        nSlots *= 2;
+    }
+    if (nSlots > slots.size()) {
+        rehash(nSlots);
+    }
+}
+
+//
+// This method removes every key.  The pair vector keeps its capacity and
+// the slot table its size, so refilling the map does not allocate.
+//
+void hashmap::clear() {
+    entries.clear();
+    slots.assign(slots.size(), EMPTY_SLOT);
+    resetBuckets();
+}
+
 //
 // This function overloads the << operator, which allows for ease in printing
 // to screen or inserting into a stream, in general.
 //
-ostream &operator<<(ostream &out, hashmap &myMap) {
+ostream &operator<<(ostream &out, const hashmap &myMap) {
     out << "{";
-    vector<int> keys = myMap.keys();
-    for (size_t i=0; i < keys.size(); i++) {
-        int key = keys[i];
-        int value = myMap.get(key);
-        out << key << ":" << value;
-        if (i < keys.size() - 1) { // no commas after the last one
+    bool first = true;
+    myMap.for_each([&](int key, int value) {
+        if (!first) { // no commas after the last one
             out << ", ";
         }
-    }
+        out << key << ":" << value;
+        first = false;
+    });
     out << "}";
     return out;
 }
 
+//
+// Reads an optionally negative decimal int straight from the stream
+// buffer.  Returns false if there is no number or it does not fit in an
+// int.
+//
+static bool readInt(streambuf* in, int &value) {
+    long long result = 0;
+    bool negative = false;
+    int c = in->sgetc();
+    while (c == ' ') {
+        c = in->snextc();
+    }
+    if (c == '-') {
+        negative = true;
+        c = in->snextc();
+    }
+    if (c < '0' || c > '9') {
+        return false;
+    }
+    while (c >= '0' && c <= '9') {
+        result = result * 10 + (c - '0');
+        if (result > (long long) INT_MAX + 1) {
+            return false;
+        }
+        c = in->snextc();
+    }
+    result = negative ? -result : result;
+    if (result > INT_MAX) {
+        return false;
+    }
+    value = (int) result;
+    return true;
+}
+
 //
 // This function overloads the >> operator, which allows for ease at extraction
 // from streams/files.
 //
+// The numbers are parsed straight out of the stream buffer.  If the text is
+// not in the format below, the stream's failbit is set.
+//
 istream &operator>>(istream &in, hashmap &myMap) {
     // assume the format {1:2, 3:4}
-    bool done = false;
-    in.get(); // get the first char, {
-    int nextChar = in.get(); // get the first real character
-    while (!done) {
-        string nextInput;
-        while (nextChar != ',' and nextChar != '}') {
-                nextInput += nextChar;
-                nextChar = in.get();
+    streambuf* buf = in.rdbuf();
+    if (buf->sbumpc() != '{') {
+        in.setstate(ios::failbit);
+        return in;
+    }
+    // special case: an empty map
+    if (buf->sgetc() == '}') {
+        buf->sbumpc();
+        return in;
+    }
+    while (true) {
+        int key, value;
+        if (!readInt(buf, key) || buf->sbumpc() != ':' || !readInt(buf, value)) {
+            in.setstate(ios::failbit);
+            return in;
         }
-        if (nextChar == ',') {
-            // read the space as well
-            in.get(); // should be a space
-            nextChar = in.get(); // get the next character
-        } else {
-            done = true; // we have reached }
+        myMap.put(key, value);
+        int nextChar = buf->sbumpc();
+        if (nextChar == '}') {
+            return in;
         }
-        // at this point, nextInput should be in the form 1:2
-        // (we should have two integers separated by a colon)
-        // BUT, we might have an empty map (special case)
-        if (nextInput != "") {
-            //vector<string> kvp;
-            size_t pos = nextInput.find(":");
-            myMap.put(stoi(nextInput.substr(0, pos)),
-                      stoi(nextInput.substr(pos+1, nextInput.length() - 1)));
+        if (nextChar != ',') {
+            in.setstate(ios::failbit);
+            return in;
         }
     }
-    return in;
 }
 
+//
+// This method writes the map as BINARY_VERSION, the # of pairs, then every
+// key and value, all as varints (see varint.h).  The pairs are written in
+// keys() order, which deserialize keeps.
+//
+void hashmap::serialize(ostream &out) const {
+    out.put((char) BINARY_VERSION);
+    writeVarint(out, entries.size());
+    for_each([&](int key, int value) {
+        writeVarint(out, zigzag(key));
+        writeVarint(out, zigzag(value));
+    });
+}
 
-
+//
+// This method adds the pairs written by serialize to the map.  Returns
+// false (with the stream's failbit set) if the data is not valid.
+//
+bool hashmap::deserialize(istream &in) {
+    streambuf* buf = in.rdbuf();
+    unsigned long long count, key, value;
+    if (buf->sbumpc() != BINARY_VERSION || !readVarint(buf, count)) {
+        in.setstate(ios::failbit);
+        return false;
+    }
+    for (unsigned long long i = 0; i < count; i++) {
+        if (!readVarint(buf, key) || !readVarint(buf, value) ||
+            unzigzag(key) != (int) unzigzag(key) || unzigzag(value) != (int) unzigzag(value)) {
+            in.setstate(ios::failbit);
+            return false;
+        }
+        put((int) unzigzag(key), (int) unzigzag(value));
+    }
+    return true;
+}
@@ -1,45 +1,118 @@
 #pragma once
 
 #include <vector>
+#include <stdexcept>
 #include <ostream>
 #include <istream>
+#include <iterator>
 using namespace std;
 
 class hashmap
 {
 public:
+    struct key_val_pair {
+        int key;
+        int value;
+        int hash;   // hashFunction(key), kept so growing never rehashes
+        int next;   // next pair in the same legacy bucket, or -1
+    };
+
+    // Walks the pairs in keys() order without copying them
+    class const_iterator {
+    public:
+        typedef forward_iterator_tag iterator_category;
+        typedef key_val_pair value_type;
+        typedef ptrdiff_t difference_type;
+        typedef const key_val_pair* pointer;
+        typedef const key_val_pair& reference;
+
+        const_iterator() : map(nullptr), bucket(LEGACY_BUCKETS), index(-1) {}
+        reference operator*() const { return map->entries[index]; }
+        pointer operator->() const { return &map->entries[index]; }
+        const_iterator& operator++();
+        const_iterator operator++(int) {
+            const_iterator old = *this;
+            ++*this;
+            return old;
+        }
+        bool operator==(const const_iterator &other) const { return index == other.index; }
+        bool operator!=(const const_iterator &other) const { return index != other.index; }
+    private:
+        friend class hashmap;
+        const_iterator(const hashmap *map, int bucket);
+        const hashmap *map;
+        int bucket;
+        int index;
+    };
+
     hashmap();
     ~hashmap();
 
     int get(int key) const;
     void put(int key, int value);
+    // adds delta to key's value (a missing key counts as 0)
+    void add(int key, int delta);
     bool containsKey(int key);
     vector<int> keys() const;
     int size();
 
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(); }
+    // calls f(key, value) for every pair, in keys() order
+    template <typename F>
+    void for_each(F f) const;
+
     void sanityCheck();
     hashmap(const hashmap &myMap); // copy constructor
     hashmap& operator= (const hashmap &myMap); // equals operator
+    hashmap(hashmap &&myMap) noexcept; // move constructor
+    hashmap& operator= (hashmap &&myMap) noexcept; // move operator
+    void swap(hashmap &myMap) noexcept;
+    // makes room for n keys, so adding them never grows the table
+    void reserve(int n);
+    // removes every key but keeps the memory for reuse
+    void clear();
     // overloads the << operator, which is VERY useful printing the hashmap
     // or writing it to a stream/file.
-    friend ostream &operator<<(ostream &out, hashmap &myMap);
+    friend ostream &operator<<(ostream &out, const hashmap &myMap);
     // overloads the >> operator, which is VERY useful for extracting it from
     // streams/files.
     friend istream &operator>>(istream &in, hashmap &myMap);
+    // writes the map in a compact binary form, and reads one back; the text
+    // form of << and >> is kept for printing and debugging.
+    void serialize(ostream &out) const;
+    bool deserialize(istream &in);
 private:
-    struct key_val_pair {
-        int key;
-        int value;
-        key_val_pair* next;
-    };
+    // A slot that holds no entry
+    static const int EMPTY_SLOT = -1;
+    // Buckets of the original chained map, which fix the order of keys()
+    static const int LEGACY_BUCKETS = 10;
+    // First byte of the binary form
+    static const int BINARY_VERSION = 1;
 
-    typedef key_val_pair** bucketArray; 
-
-    bucketArray createBucketArray(int nBuckets);
     int hashFunction(int input) const;
+    int findSlot(int key, int hash) const;
+    void rehash(size_t nSlots);
+    void insertAt(int index, int key, int value, int hash);
+    void resetBuckets();
+    void copyBuckets(const hashmap &myMap);
 
-    bucketArray buckets;
-
-    int nBuckets;
-    int nElems;
+    vector<key_val_pair> entries;  // every pair, in insertion order
+    vector<int> slots;             // index into entries, or EMPTY_SLOT
+    // first and last pair of each legacy bucket's list, or -1
+    int bucketHead[LEGACY_BUCKETS];
+    int bucketTail[LEGACY_BUCKETS];
 };
+
+template <typename F>
+void hashmap::for_each(F f) const {
+    for (int b = 0; b < LEGACY_BUCKETS; b++) {
+        for (int i = bucketHead[b]; i != -1; i = entries[i].next) {
+            f(entries[i].key, entries[i].value);
+        }
+    }
+}
+
+inline void swap(hashmap &a, hashmap &b) noexcept {
+    a.swap(b);
+}
@@ -0,0 +1,252 @@
+// Shayan Rasheed
+// CS 251 - Project 6
+// File Compression App
+// LZ77 match finder, run before Huffman coding on repetitive input.  The
+// data is parsed into sequences: some literal bytes, then a match (copy
+// length bytes from distance bytes back).  Matches are found through hash
+// chains: the first 4 bytes at every position are hashed, head[] holds
+// the latest position with each hash and prev[] links each position to
+// the one before it with the same hash, so a search walks back through
+// the window from the newest candidate.
+//
+// The sequences are split into separate byte streams (tokens, literals,
+// long lengths, and the two halves of the distances), so each stream can
+// be Huffman coded on its own with the existing block coder in util.h.
+
+#pragma once
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include "varint.h"
+
+using namespace std;
+
+// Shortest match worth coding
+const int LZ_MIN_MATCH = 4;
+// Longest match, which bounds the time spent extending one
+const int LZ_MAX_MATCH = 1 << 16;
+// Default and largest distance a match can reach back (powers of two)
+const int LZ_DEFAULT_WINDOW = 1 << 16;
+const int LZ_MAX_WINDOW = 1 << 24;
+// Default # of candidates a search looks at
+const int LZ_DEFAULT_CHAIN = 32;
+// Matches at least this long are taken without checking the next position
+const int LZ_LAZY_LIMIT = 32;
+const int LZ_HASH_BITS = 16;
+
+// The parsed sequences of one block
+struct lzStreams {
+    // One byte per sequence: the literal count in the high 4 bits and the
+    // match length - LZ_MIN_MATCH in the low 4 bits.  15 means the rest of
+    // the number follows in lengths.  The last sequence has no match.
+    string tokens;
+    string literals;
+    string lengths;   // varints
+    string distLow;   // low byte of each distance
+    string distHigh;  // distance >> 8, as a varint
+};
+
+inline uint32_t lzHash(const char* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+//
+// lzMatchLength
+// Returns how many bytes a and b have in common, up to limit, comparing 8
+// at a time.
+//
+inline size_t lzMatchLength(const char* a, const char* b, size_t limit) {
+    size_t n = 0;
+    while (n + 8 <= limit) {
+      uint64_t x, y;
+      memcpy(&x, a + n, 8);
+      memcpy(&y, b + n, 8);
+      if (x != y) {
+        return n + __builtin_ctzll(x ^ y) / 8;
+      }
+      n += 8;
+    }
+    while (n < limit && a[n] == b[n]) {
+      n++;
+    }
+    return n;
+}
+
+//
+// lzEmit
+// Adds a sequence of nLiterals bytes at literals followed by a match of
+// length bytes at distance.  length 0 marks the last sequence.
+//
+inline void lzEmit(lzStreams& out, const char* literals, size_t nLiterals,
+                   size_t length, size_t distance) {
+    size_t lengthCode = (length == 0) ? 0 : length - LZ_MIN_MATCH;
+    out.tokens.push_back((char) ((min(nLiterals, (size_t) 15) << 4) | min(lengthCode, (size_t) 15)));
+    if (nLiterals >= 15) {
+      writeVarint(out.lengths, nLiterals - 15);
+    }
+    out.literals.append(literals, nLiterals);
+    if (length == 0) {
+      return;
+    }
+    if (lengthCode >= 15) {
+      writeVarint(out.lengths, lengthCode - 15);
+    }
+    out.distLow.push_back((char) distance);
+    writeVarint(out.distHigh, distance >> 8);
+}
+
+//
+// lzParse
+// Parses the n bytes of data into out.  window (a power of two, at most
+// LZ_MAX_WINDOW) is how far back a match may start, and maxChain how many
+// candidates each search looks at.  If the next position has a longer
+// match than this one, this byte is sent as a literal instead (lazy
+// matching).
+//
+inline void lzParse(const char* data, size_t n, int window, int maxChain, lzStreams& out) {
+    out = lzStreams();
+    vector<int> head(1 << LZ_HASH_BITS, -1);
+    // prev needs a slot per position in the window, or per byte of data
+    // when there is less data than that
+    size_t slots = 1;
+    while (slots < (size_t) window && slots < n) {
+      slots *= 2;
+    }
+    vector<int> prev(slots);
+    const size_t mask = slots - 1;
+
+    auto insert = [&](size_t pos) {
+      uint32_t h = lzHash(data + pos);
+      prev[pos & mask] = head[h];
+      head[h] = (int) pos;
+    };
+    // Returns the longest match at pos (0 if none), and its distance
+    auto find = [&](size_t pos, size_t& distance) -> size_t {
+      size_t best = 0;
+      size_t limit = min((size_t) LZ_MAX_MATCH, n - pos);
+      int candidate = head[lzHash(data + pos)];
+      for (int chain = maxChain; candidate >= 0 && chain > 0; chain--) {
+        if (pos - candidate >= (size_t) window) {
+          break;
+        }
+        // Only a candidate that matches one byte further can win
+        if (data[candidate + best] == data[pos + best]) {
+          size_t length = lzMatchLength(data + candidate, data + pos, limit);
+          if (length > best) {
+            best = length;
+            distance = pos - candidate;
+            if (length == limit) {
+              break;
+            }
+          }
+        }
+        candidate = prev[candidate & mask];
+      }
+      return (best >= (size_t) LZ_MIN_MATCH) ? best : 0;
+    };
+
+    size_t literalStart = 0;
+    size_t pos = 0;
+    while (pos + LZ_MIN_MATCH <= n) {
+      size_t distance = 0;
+      size_t length = find(pos, distance);
+      insert(pos);
+      if (length > 0 && length < (size_t) LZ_LAZY_LIMIT && pos + 1 + LZ_MIN_MATCH <= n) {
+        size_t nextDistance;
+        if (find(pos + 1, nextDistance) > length) {
+          pos++;
+          continue;
+        }
+      }
+      if (length == 0) {
+        pos++;
+        continue;
+      }
+      lzEmit(out, data + literalStart, pos - literalStart, length, distance);
+      // Every position inside the match can start a later match
+      size_t end = pos + length;
+      for (pos++; pos < end && pos + LZ_MIN_MATCH <= n; pos++) {
+        insert(pos);
+      }
+      pos = end;
+      literalStart = end;
+    }
+    lzEmit(out, data + literalStart, n - literalStart, 0, 0);
+}
+
+//
+// lzRebuild
+// Writes the n bytes described by in to out.  Returns false if the
+// streams are damaged or do not describe exactly n bytes.
+//
+inline bool lzRebuild(const lzStreams& in, char* out, size_t n) {
+    const char* token = in.tokens.data();
+    const char* tokenEnd = token + in.tokens.size();
+    const char* literal = in.literals.data();
+    const char* literalEnd = literal + in.literals.size();
+    const char* length = in.lengths.data();
+    const char* lengthEnd = length + in.lengths.size();
+    const char* low = in.distLow.data();
+    const char* lowEnd = low + in.distLow.size();
+    const char* high = in.distHigh.data();
+    const char* highEnd = high + in.distHigh.size();
+
+    size_t o = 0;
+    while (token < tokenEnd) {
+      unsigned char t = (unsigned char) *token++;
+      unsigned long long extra;
+      size_t nLiterals = t >> 4;
+      if (nLiterals == 15) {
+        if (!readVarint(length, lengthEnd, extra) || extra > n) {
+          return false;
+        }
+        nLiterals += extra;
+      }
+      if (nLiterals > n - o || nLiterals > (size_t) (literalEnd - literal)) {
+        return false;
+      }
+      memcpy(out + o, literal, nLiterals);
+      literal += nLiterals;
+      o += nLiterals;
+      if (token == tokenEnd) {
+        break;  // the last sequence has no match
+      }
+
+      size_t matchLength = t & 15;
+      if (matchLength == 15) {
+        if (!readVarint(length, lengthEnd, extra) || extra > n) {
+          return false;
+        }
+        matchLength += extra;
+      }
+      matchLength += LZ_MIN_MATCH;
+      unsigned long long distance;
+      if (low == lowEnd || !readVarint(high, highEnd, distance) || distance > n) {
+        return false;
+      }
+      distance = (distance << 8) | (unsigned char) *low++;
+      if (distance == 0 || distance > o || matchLength > n - o) {
+        return false;
+      }
+
+      // Copy 8 bytes at a time unless the match overlaps itself that closely
+      char* dst = out + o;
+      const char* src = dst - distance;
+      size_t i = 0;
+      if (distance >= 8) {
+        for (; i + 8 <= matchLength; i += 8) {
+          memcpy(dst + i, src + i, 8);
+        }
+      }
+      for (; i < matchLength; i++) {
+        dst[i] = src[i];
+      }
+      o += matchLength;
+    }
+    return o == n && literal == literalEnd && length == lengthEnd &&
+           low == lowEnd && high == highEnd;
+}
@@ -16,6 +16,11 @@
 #include <queue>
 #include <vector>
 #include <functional>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <climits>
 #include <ctype.h>
 #include <math.h>
 #include "bitstream.h"
@@ -28,19 +33,24 @@ string menu();
 bool is123456(string choice);
 void do123456(string choice, string &filename, bool &isFile,
              hashmap &frequencyMap,
-             HuffmanNode* &encodingTree,
+             HuffmanTree &encodingTree,
              mymap <int, string> &encodingMap);
 string printChar(int val);
 void printMap(mymap <int, string> &map);
 void printMap(hashmap &map);
-void printTree(HuffmanNode* node, string str);
+void printTree(const HuffmanTree& tree, HuffmanIndex node, string str);
 void printTextFile(string filename);
 void printBinaryFile(string filename);
+int runCommandLine(int argc, char* argv[]);
+
+int main(int argc, char* argv[]) {
+    // Any arguments mean the command-line mode instead of the menu
+    if (argc > 1) {
+        return runCommandLine(argc, argv);
+    }
 
-int main() {
-  
     hashmap frequencyMap;
-    HuffmanNode* encodingTree = nullptr;
+    HuffmanTree encodingTree;
     mymap <int, string> encodingMap;
     string filename;
     bool isFile = true;
@@ -121,7 +131,7 @@ bool is123456(string choice) {
 //
 void do123456(string choice, string &filename, bool &isFile,
              hashmap &frequencyMap,
-             HuffmanNode* &encodingTree,
+             HuffmanTree &encodingTree,
              mymap <int, string> &encodingMap) {
     // gets file/string and filename.
     if (choice == "1") {
@@ -138,7 +148,17 @@ void do123456(string choice, string &filename, bool &isFile,
     }
     // Build Frequency Map
     if (choice == "1") {
-        buildFrequencyMap(filename, isFile, frequencyMap);
+        try {
+            buildFrequencyMap(filename, isFile, frequencyMap);
+        } catch (const exception &e) {
+            cout << endl;
+            cout << "********************************" << endl;
+            cout << e.what() << endl;
+            cout << "Enter Q to start over and try again." << endl;
+            cout << "********************************" << endl;
+            cout << endl;
+            return;
+        }
         cout << endl;
         cout << "Building frequency map..." << endl;
         printMap(frequencyMap);
@@ -148,7 +168,7 @@ void do123456(string choice, string &filename, bool &isFile,
         encodingTree = buildEncodingTree(frequencyMap);
         cout << endl;
         cout << "Building encoding tree..." << endl;
-        printTree(encodingTree, "");
+        printTree(encodingTree, encodingTree.root, "");
         cout << endl;
     // Build Encoding Map
     } else if (choice == "3") {
@@ -261,9 +281,9 @@ string printChar(int ch){
 //
 //
 void printMap(hashmap &map) {
-    for (int key : map.keys()) {
-        cout << key << ": " << '\t' << printChar(key);
-        cout << '\t' << "-->" << '\t' << map.get(key) << endl;
+    for (const auto& pair : map) {
+        cout << pair.key << ": " << '\t' << printChar(pair.key);
+        cout << '\t' << "-->" << '\t' << pair.value << endl;
     }
 }
 
@@ -282,16 +302,16 @@ void printMap(mymap <int, string> &map) {
 // printTree
 //
 //
-void printTree(HuffmanNode* node, string str) {
-    if (node == nullptr) {
+void printTree(const HuffmanTree& tree, HuffmanIndex node, string str) {
+    if (node == NO_NODE) {
         return;
     } else {
-        cout << str << "{" << printChar(node->character);
-        if (node->character != NOT_A_CHAR)
-            cout << "(" << node->character << ")";
-        cout << ", count=" << node->count << "}" << endl;
-        printTree(node->zero, str+" ");
-        printTree(node->one, str+" ");
+        cout << str << "{" << printChar(tree[node].character);
+        if (tree[node].character != NOT_A_CHAR)
+            cout << "(" << tree[node].character << ")";
+        cout << ", count=" << tree[node].count << "}" << endl;
+        printTree(tree, tree[node].zero, str+" ");
+        printTree(tree, tree[node].one, str+" ");
     }
 }
 
@@ -338,3 +358,320 @@ void printBinaryFile(string filename) {
     }
     cout << endl;
 }
+
+// Options of the command-line mode
+struct cliOptions {
+    bool compress;
+    bool decompress;
+    bool stats;
+    string output;       // output file, or directory with several inputs
+    int threads;
+    long long blockSize; // 0 for the single-table format
+    int codec;
+    vector<string> inputs;
+};
+
+// Result of one file of the command-line mode
+struct cliResult {
+    string input;
+    string output;
+    bool ok;
+    string error;   // what() of an exception that failed the file, if any
+    double seconds;
+    HuffmanStats stats;
+};
+
+//
+// printUsage
+//
+//
+void printUsage() {
+    cerr << "usage: program.exe (-c | -d) [options] [file ...]" << endl
+         << "  -c                compress each file to file.huf" << endl
+         << "  -d                decompress each file.huf to file" << endl
+         << "  -o PATH           output file (one input) or directory (several)" << endl
+         << "  --threads N       files processed at once (default: # of cores)" << endl
+         << "  --block-size N    compress to the block container with N-byte blocks" << endl
+         << "                    (K, M and G suffixes allowed); frame size with stdin" << endl
+         << "  --codec NAME      huffman (default), rans or lz77" << endl
+         << "  --stats           print sizes and timings to stderr" << endl
+         << "With no file, or -, stdin is compressed to (or decompressed from) the" << endl
+         << "stream format on stdout." << endl;
+}
+
+//
+// parseCount
+// Reads a positive count with an optional K, M or G suffix.
+//
+bool parseCount(string text, long long &value) {
+    char* end;
+    value = strtoll(text.c_str(), &end, 10);
+    string suffix = end;
+    int shift = 0;
+    if (suffix == "K" || suffix == "k") {
+        shift = 10;
+    } else if (suffix == "M" || suffix == "m") {
+        shift = 20;
+    } else if (suffix == "G" || suffix == "g") {
+        shift = 30;
+    } else if (!suffix.empty()) {
+        return false;
+    }
+    // strtoll saturates at LLONG_MAX; refuse anything the shift would overflow
+    if (end == text.c_str() || value <= 0 || value == LLONG_MAX || value > (LLONG_MAX >> shift)) {
+        return false;
+    }
+    value <<= shift;
+    return true;
+}
+
+//
+// parseArguments
+// Fills in options from argv.  Options that take a value accept it as the
+// next argument or after '=' (--threads=4).  Returns false on a bad
+// argument.
+//
+bool parseArguments(int argc, char* argv[], cliOptions &options) {
+    options.compress = false;
+    options.decompress = false;
+    options.stats = false;
+    options.threads = defaultThreads();
+    options.blockSize = 0;
+    options.codec = HUFFMAN_VERSION;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        string value;
+        bool hasValue = false;
+        if (arg.compare(0, 2, "--") == 0 && arg.find('=') != string::npos) {
+            value = arg.substr(arg.find('=') + 1);
+            arg = arg.substr(0, arg.find('='));
+            hasValue = true;
+        }
+        bool takesValue = (arg == "-o" || arg == "--threads" || arg == "--block-size" ||
+                           arg == "--codec");
+        if (takesValue && !hasValue) {
+            if (i + 1 >= argc) {
+                cerr << arg << " needs a value" << endl;
+                return false;
+            }
+            value = argv[++i];
+        }
+
+        long long count;
+        if (arg == "-c") {
+            options.compress = true;
+        } else if (arg == "-d") {
+            options.decompress = true;
+        } else if (arg == "--stats") {
+            options.stats = true;
+        } else if (arg == "-o") {
+            options.output = value;
+        } else if (arg == "--threads" && parseCount(value, count) && count <= 1024) {
+            options.threads = (int) count;
+        } else if (arg == "--block-size" && parseCount(value, count) && count <= (1 << 30)) {
+            options.blockSize = count;
+        } else if (arg == "--codec" && (value == "huffman" || value == "rans" || value == "lz77")) {
+            options.codec = (value == "rans") ? RANS_VERSION :
+                            (value == "lz77") ? LZ77_VERSION : HUFFMAN_VERSION;
+        } else if (arg == "-" || arg[0] != '-') {
+            options.inputs.push_back(arg);
+        } else {
+            cerr << "bad argument: " << argv[i] << endl;
+            return false;
+        }
+    }
+    if (options.compress == options.decompress) {
+        cerr << "give exactly one of -c and -d" << endl;
+        return false;
+    }
+    if (options.blockSize > 0 && options.codec != HUFFMAN_VERSION && options.compress) {
+        cerr << "--block-size only applies to the huffman codec" << endl;
+        return false;
+    }
+    return true;
+}
+
+//
+// outputName
+// Returns the output file for input: -o if it names a file, otherwise
+// input + ".huf" when compressing, or input without ".huf" when
+// decompressing (input + ".out" if it does not end in ".huf"), placed in
+// the -o directory if there is one.
+//
+string outputName(const cliOptions &options, string input) {
+    if (!options.output.empty() && options.inputs.size() == 1) {
+        return options.output;
+    }
+    string name = input;
+    const string suffix = ".huf";
+    if (options.compress) {
+        name += suffix;
+    } else if (name.size() > suffix.size() &&
+               name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+        name.erase(name.size() - suffix.size());
+    } else {
+        name += ".out";
+    }
+    if (!options.output.empty()) {
+        size_t slash = name.rfind('/');
+        name = options.output + "/" + (slash == string::npos ? name : name.substr(slash + 1));
+    }
+    return name;
+}
+
+//
+// processFile
+// Compresses or decompresses one file, timing it.  innerThreads is given
+// to the block container, both ways.
+//
+cliResult processFile(const cliOptions &options, string input, int innerThreads) {
+    cliResult result;
+    result.input = input;
+    result.output = outputName(options, input);
+    result.stats = HuffmanStats{0, 0, 0};
+    auto start = chrono::steady_clock::now();
+    // A damaged file can throw (a bad code table, or a size that fails an
+    // allocation); that fails this file, not the others
+    try {
+        if (result.output == input) {
+            result.ok = false;
+        } else if (options.decompress) {
+            result.ok = decompressFile(input, result.output, &result.stats, nullptr,
+                                       innerThreads);
+        } else if (options.blockSize > 0) {
+            result.ok = compressBlocks(input, result.output, innerThreads,
+                                       (int) options.blockSize, &result.stats);
+        } else {
+            result.ok = compressFile(input, result.output, &result.stats, nullptr, 0,
+                                     options.codec);
+        }
+    } catch (const exception &e) {
+        result.ok = false;
+        result.error = e.what();
+    }
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+//
+// uncompressedBytes
+// Returns the size of the uncompressed side of result, which throughput
+// is measured in.
+//
+long long uncompressedBytes(const cliOptions &options, const cliResult &result) {
+    return options.compress ? result.stats.inputBytes : result.stats.outputBytes;
+}
+
+//
+// printStats
+// Prints one line of sizes and timing for result.
+//
+void printStats(const cliOptions &options, const cliResult &result) {
+    cerr << result.input << " -> " << result.output << ": "
+         << result.stats.inputBytes << " -> " << result.stats.outputBytes << " bytes"
+         << " (header " << result.stats.headerBytes << "), " << result.seconds << " s, "
+         << uncompressedBytes(options, result) / 1e6 / max(result.seconds, 1e-9)
+         << " MB/s" << endl;
+}
+
+//
+// runStream
+// Compresses stdin to stdout in the stream format, or decompresses a
+// stream from stdin to stdout.
+//
+int runStream(const cliOptions &options) {
+    ios::sync_with_stdio(false);
+    ofstream file;
+    if (!options.output.empty()) {
+        file.open(options.output, ios::binary);
+        if (!file.is_open()) {
+            cerr << "cannot open " << options.output << endl;
+            return 1;
+        }
+    }
+    ostream &output = options.output.empty() ? cout : file;
+    cliResult result;
+    result.input = "stdin";
+    result.output = options.output.empty() ? "stdout" : options.output;
+    result.stats = HuffmanStats{0, 0, 0};
+    auto start = chrono::steady_clock::now();
+    try {
+        if (options.compress) {
+            int blockSize = options.blockSize > 0 ? (int) options.blockSize : STREAM_BLOCK_SIZE;
+            result.ok = compressStream(0, output, blockSize, STREAM_REBUILD_BYTES, &result.stats);
+        } else {
+            result.ok = decompressStream(cin, output, &result.stats);
+        }
+    } catch (const exception &e) {
+        result.ok = false;
+        result.error = e.what();
+    }
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    output.flush();
+    if (!result.ok) {
+        cerr << "cannot " << (options.compress ? "compress" : "decompress") << " stdin"
+             << (result.error.empty() ? "" : ": " + result.error) << endl;
+        return 1;
+    }
+    if (options.stats) {
+        printStats(options, result);
+    }
+    return 0;
+}
+
+//
+// runCommandLine
+// The command-line mode: compresses or decompresses every input file,
+// up to --threads files at a time.  Returns the exit status.
+//
+int runCommandLine(int argc, char* argv[]) {
+    cliOptions options;
+    if (!parseArguments(argc, argv, options)) {
+        printUsage();
+        return 2;
+    }
+    if (options.inputs.empty() || (options.inputs.size() == 1 && options.inputs[0] == "-")) {
+        return runStream(options);
+    }
+
+    // Each worker takes the next file; the threads left over go to the
+    // block container of each file
+    int workers = min((int) options.inputs.size(), options.threads);
+    int innerThreads = max(1, options.threads / workers);
+    vector<cliResult> results(options.inputs.size());
+    atomic<size_t> next(0);
+    auto work = [&]() {
+        for (size_t i = next++; i < options.inputs.size(); i = next++) {
+            results[i] = processFile(options, options.inputs[i], innerThreads);
+        }
+    };
+    auto start = chrono::steady_clock::now();
+    vector<thread> threads;
+    for (int t = 1; t < workers; t++) {
+        threads.emplace_back(work);
+    }
+    work();
+    for (auto &th : threads) {
+        th.join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    int status = 0;
+    long long totalBytes = 0;
+    for (const cliResult &result : results) {
+        if (!result.ok) {
+            cerr << "cannot " << (options.compress ? "compress " : "decompress ")
+                 << result.input << (result.error.empty() ? "" : ": " + result.error) << endl;
+            status = 1;
+        } else if (options.stats) {
+            printStats(options, result);
+        }
+        totalBytes += uncompressedBytes(options, result);
+    }
+    if (options.stats && results.size() > 1) {
+        cerr << results.size() << " files, " << seconds << " s, "
+             << totalBytes / 1e6 / max(seconds, 1e-9) << " MB/s on " << workers
+             << " threads" << endl;
+    }
+    return status;
+}
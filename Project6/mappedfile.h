@@ -0,0 +1,121 @@
+// Shayan Rasheed
+// CS 251 - Project 6
+// File Compression App
+// Read-only view of a whole input file.  Regular files are memory mapped,
+// so compress can scan the same pages twice (once to count, once to
+// encode) without copying them through a stream.  Anything that cannot be
+// mapped (pipes, terminals, /proc files) is read into memory instead.
+
+#pragma once
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+// Size of the reads used when a file cannot be mapped
+const int MAPPED_READ_SIZE = 1 << 16;
+
+class mappedfile {
+ private:
+    const char* bytes;
+    size_t length;
+    bool mapped;
+    bool opened;
+    vector<char> copy;  // the data when the file is not mapped
+
+    void release() {
+      if (mapped) {
+        munmap((void*) bytes, length);
+      }
+      bytes = nullptr;
+      length = 0;
+      mapped = false;
+      opened = false;
+      copy.clear();
+    }
+
+ public:
+    mappedfile() : bytes(nullptr), length(0), mapped(false), opened(false) {
+    }
+
+    explicit mappedfile(const string& filename)
+      : bytes(nullptr), length(0), mapped(false), opened(false) {
+      open(filename);
+    }
+
+    ~mappedfile() {
+      release();
+    }
+
+    // The mapping belongs to exactly one object
+    mappedfile(const mappedfile&) = delete;
+    mappedfile& operator=(const mappedfile&) = delete;
+
+    //
+    // open
+    // Maps filename if it is a non-empty regular file, otherwise reads it
+    // to the end.  Returns false if the file cannot be opened or read.
+    //
+    bool open(const string& filename) {
+      release();
+      int fd = ::open(filename.c_str(), O_RDONLY);
+      if (fd < 0) {
+        return false;
+      }
+      struct stat info;
+      if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void* p = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+          madvise(p, info.st_size, MADV_SEQUENTIAL);
+          bytes = (const char*) p;
+          length = info.st_size;
+          mapped = true;
+          opened = true;
+          ::close(fd);
+          return true;
+        }
+      }
+
+      // Fall back to buffered reads
+      size_t used = 0;
+      while (true) {
+        copy.resize(used + MAPPED_READ_SIZE);
+        ssize_t n = ::read(fd, copy.data() + used, MAPPED_READ_SIZE);
+        if (n < 0) {
+          ::close(fd);
+          copy.clear();
+          return false;
+        }
+        if (n == 0) {
+          break;
+        }
+        used += n;
+      }
+      ::close(fd);
+      copy.resize(used);
+      bytes = copy.data();
+      length = used;
+      opened = true;
+      return true;
+    }
+
+    bool is_open() const {
+      return opened;
+    }
+
+    bool isMapped() const {
+      return mapped;
+    }
+
+    const char* data() const {
+      return bytes;
+    }
+
+    size_t size() const {
+      return length;
+    }
+};
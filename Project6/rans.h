@@ -0,0 +1,167 @@
+// Shayan Rasheed
+// CS 251 - Project 6
+// File Compression App
+// Order-0 range asymmetric numeral system (rANS) coder, an alternative to
+// the Huffman codes in util.h.  Huffman spends a whole number of bits on
+// every symbol, so a byte that is 90% of the input still costs one bit;
+// rANS spends close to -log2(p) bits, fractions included.
+//
+// The byte counts are scaled to frequencies that add up to RANS_TOTAL.
+// The coder's state is a 32-bit integer kept in [RANS_LOW, RANS_LOW * 256)
+// by shifting whole bytes out (encoder) or in (decoder).  Two states take
+// turns (even and odd positions), so the decoder has two independent
+// dependency chains to overlap.  rANS decodes in the reverse of the order
+// it encodes, so the encoder runs from the end of the data to the start
+// and fills its buffer from the back.
+
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+// Frequencies add up to 1 << RANS_PROB_BITS
+const int RANS_PROB_BITS = 14;
+const uint32_t RANS_TOTAL = 1u << RANS_PROB_BITS;
+// Lower bound of the normalized state
+const uint32_t RANS_LOW = 1u << 23;
+// Bytes the final states take at the start of an encoded chunk
+const int RANS_STATE_BYTES = 8;
+
+//
+// normalizeFrequencies
+// Scales counts to freqs that add up to RANS_TOTAL, giving every byte that
+// occurs a frequency of at least 1.  Bytes that do not occur get 0.  If
+// no byte occurs, every freq is 0.
+//
+inline void normalizeFrequencies(const long long counts[256], uint32_t freqs[256]) {
+    long long total = 0;
+    for (int b = 0; b < 256; b++) {
+      total += counts[b];
+    }
+    long long sum = 0;
+    int largest = 0;
+    for (int b = 0; b < 256; b++) {
+      freqs[b] = 0;
+      if (counts[b] > 0) {
+        freqs[b] = (uint32_t) max(1LL, (long long) ((double) counts[b] * RANS_TOTAL / total));
+        sum += freqs[b];
+        if (counts[b] > counts[largest]) {
+          largest = b;
+        }
+      }
+    }
+    if (total == 0) {
+      return;
+    }
+    // Rounding leaves sum a little off: give the difference to the most
+    // common byte, or take it from whichever bytes can spare it most
+    // cheaply (the largest frequencies)
+    if (sum < RANS_TOTAL) {
+      freqs[largest] += RANS_TOTAL - sum;
+    }
+    while (sum > RANS_TOTAL) {
+      int best = -1;
+      for (int b = 0; b < 256; b++) {
+        if (freqs[b] > 1 && (best < 0 || freqs[b] > freqs[best])) {
+          best = b;
+        }
+      }
+      long long take = min(sum - RANS_TOTAL, (long long) freqs[best] / 2);
+      take = max(take, 1LL);
+      freqs[best] -= (uint32_t) take;
+      sum -= take;
+    }
+}
+
+//
+// ransEncode
+// Encodes the n bytes of data with freqs (from normalizeFrequencies, and
+// non-zero for every byte of data) and returns the encoded bytes.
+//
+inline string ransEncode(const char* data, size_t n, const uint32_t freqs[256]) {
+    uint32_t starts[256];
+    uint32_t start = 0;
+    for (int b = 0; b < 256; b++) {
+      starts[b] = start;
+      start += freqs[b];
+    }
+
+    // Each byte adds at most RANS_PROB_BITS bits, plus the two states
+    vector<unsigned char> buffer(n * 2 + RANS_STATE_BYTES);
+    unsigned char* end = buffer.data() + buffer.size();
+    unsigned char* p = end;
+    uint32_t states[2] = {RANS_LOW, RANS_LOW};
+    for (size_t i = n; i-- > 0;) {
+      unsigned char s = (unsigned char) data[i];
+      uint32_t& x = states[i & 1];
+      uint32_t freq = freqs[s];
+      // Shift out bytes until encoding s keeps x below RANS_LOW * 256
+      uint32_t xMax = ((RANS_LOW >> RANS_PROB_BITS) << 8) * freq;
+      while (x >= xMax) {
+        *--p = (unsigned char) x;
+        x >>= 8;
+      }
+      x = ((x / freq) << RANS_PROB_BITS) + (x % freq) + starts[s];
+    }
+    // The decoder reads state 0 first, then state 1
+    for (int k = 1; k >= 0; k--) {
+      p -= 4;
+      for (int j = 0; j < 4; j++) {
+        p[j] = (unsigned char) (states[k] >> (8 * j));
+      }
+    }
+    return string((const char*) p, end - p);
+}
+
+//
+// ransDecode
+// Decodes n bytes from the size bytes at data (made by ransEncode with the
+// same freqs) into out.  Returns false if the data is damaged or freqs do
+// not add up to RANS_TOTAL.
+//
+inline bool ransDecode(const char* data, size_t size, const uint32_t freqs[256],
+                       char* out, size_t n) {
+    // slot -> byte, and where each byte's slots start
+    static thread_local unsigned char symbols[RANS_TOTAL];
+    uint32_t starts[256];
+    uint32_t start = 0;
+    for (int b = 0; b < 256; b++) {
+      // checked before filling, so a bad table cannot run past symbols
+      if (freqs[b] > RANS_TOTAL - start) {
+        return false;
+      }
+      starts[b] = start;
+      for (uint32_t j = 0; j < freqs[b]; j++) {
+        symbols[start + j] = (unsigned char) b;
+      }
+      start += freqs[b];
+    }
+    if (size < (size_t) RANS_STATE_BYTES || (n > 0 && start != RANS_TOTAL)) {
+      return false;
+    }
+
+    const unsigned char* p = (const unsigned char*) data;
+    const unsigned char* end = p + size;
+    uint32_t states[2];
+    for (int k = 0; k < 2; k++) {
+      states[k] = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+      p += 4;
+    }
+    const uint32_t mask = RANS_TOTAL - 1;
+    for (size_t i = 0; i < n; i++) {
+      uint32_t& x = states[i & 1];
+      unsigned char s = symbols[x & mask];
+      out[i] = (char) s;
+      x = freqs[s] * (x >> RANS_PROB_BITS) + (x & mask) - starts[s];
+      while (x < RANS_LOW) {
+        if (p == end) {
+          return false;
+        }
+        x = (x << 8) | *p++;
+      }
+    }
+    // Decoding undoes every step, back to the encoder's first states
+    return p == end && states[0] == RANS_LOW && states[1] == RANS_LOW;
+}
@@ -0,0 +1,312 @@
+// Shayan Rasheed
+// CS 251 - Project 6
+// File Compression App
+// Tests for util.h: each test prints what failed, or that it passed, and
+// returns false on failure.
+//
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cstring>
+#include <fstream>
+#include <cstdio>
+#include <iterator>
+#include "bitstream.h"
+#include "util.h"
+
+using namespace std;
+
+// hashFunction(1895428345) is INT_MIN, which has no positive value; its
+// pair must still land in a legacy bucket and be found and listed
+bool testHashmapIntMin() {
+    const int key = 1895428345;
+    hashmap map;
+    map.put(7, 1);
+    map.put(key, 2);
+    map.add(key, 3);
+    map.put(-key, 4);
+    if (map.get(key) != 5 || !map.containsKey(key) || map.get(-key) != 4) {
+      cout << "testHashmapIntMin: key not found" << endl;
+      return false;
+    }
+    vector<int> keys = map.keys();
+    int listed = 0;
+    for (int k : keys) {
+      listed += (k == key);
+    }
+    if (keys.size() != 3 || listed != 1) {
+      cout << "testHashmapIntMin: keys() lost or repeated the key" << endl;
+      return false;
+    }
+    cout << "testHashmapIntMin: all passed!" << endl;
+    return true;
+}
+
+// Feeds rANS frequency tables that do not add up to RANS_TOTAL to the
+// table reader, the chunk decoder and the container decoder
+bool testRansCorruptTable() {
+    // every byte present with the largest frequency: 256 * RANS_TOTAL
+    string table(32, '\xff');
+    for (int i = 0; i < 256; i++) {
+      writeVarint(table, RANS_TOTAL);
+    }
+    uint32_t freqs[256];
+    istringstream tooBig(table);
+    if (readFrequencyTable(tooBig, freqs, false)) {
+      cout << "testRansCorruptTable: table over RANS_TOTAL accepted" << endl;
+      return false;
+    }
+
+    // one byte short of RANS_TOTAL
+    string shortTable(32, '\0');
+    shortTable[0] = 1;
+    writeVarint(shortTable, RANS_TOTAL - 1);
+    istringstream tooSmall(shortTable);
+    if (readFrequencyTable(tooSmall, freqs, false)) {
+      cout << "testRansCorruptTable: table under RANS_TOTAL accepted" << endl;
+      return false;
+    }
+
+    // ransDecode must stop before filling its slot table past the end
+    for (int i = 0; i < 256; i++) {
+      freqs[i] = RANS_TOTAL;
+    }
+    char out[16];
+    char data[RANS_STATE_BYTES] = {0};
+    if (ransDecode(data, sizeof(data), freqs, out, sizeof(out))) {
+      cout << "testRansCorruptTable: ransDecode accepted a bad table" << endl;
+      return false;
+    }
+
+    // a real container whose first frequency is raised by one
+    string input = "abracadabra, abracadabra";
+    ostringstream packed;
+    compressRans(input.data(), input.size(), packed, nullptr);
+    string good = packed.str();
+    ostringstream unpacked;
+    if (!decompressRans(good.data(), good.size(), unpacked) || unpacked.str() != input) {
+      cout << "testRansCorruptTable: good container failed" << endl;
+      return false;
+    }
+    // magic, version, 1-byte length, then the 32-byte bitmap
+    size_t firstFreq = 4 + 1 + 1 + 32;
+    string bad = good;
+    bad[firstFreq]++;
+    ostringstream discard;
+    if (decompressRans(bad.data(), bad.size(), discard)) {
+      cout << "testRansCorruptTable: container with a bad table accepted" << endl;
+      return false;
+    }
+    cout << "testRansCorruptTable: all passed!" << endl;
+    return true;
+}
+
+// The frequency map, its header and the codes must match what the
+// original char-at-a-time buildFrequencyMap produced, since menu steps 1-4
+// print them and write them to the .huf file
+bool testFrequencyMapOrder() {
+    string text = "It was the best of times, it was the worst of times.\nZebras & yaks!\n";
+    // golden output of the original code for text
+    string expectedHeader = "{116:8, 119:3, 104:2, 46:1, 10:2, 33:1, 73:1, 90:1, 38:1, 97:4, 98:2, 107:1, 256:1, 101:6, 115:8, 111:3, 121:1, 44:1, 114:2, 32:13, 102:2, 105:3, 109:2}";
+    string expectedBits =
+      "1100000101111101100110111110101010000011110110000011010111001010"
+      "0001110101100111010100001110011111111001010111110110011011111010"
+      "1010000011111011001010001011010111001010000111010110011101010000"
+      "1110010010101101111000101101000100110111111001101111101000011110"
+      "00101110010110101101110";
+
+    hashmap frequencyMap;
+    buildFrequencyMap(text, false, frequencyMap);
+    ostringstream header;
+    header << frequencyMap;
+    if (header.str() != expectedHeader) {
+      cout << "testFrequencyMapOrder: header changed: " << header.str() << endl;
+      return false;
+    }
+    HuffmanTree encodingTree = buildEncodingTree(frequencyMap);
+    mymap<int, string> encodingMap = buildEncodingMap(encodingTree);
+    freeTree(encodingTree);
+    string bits;
+    for (char c : text) {
+      bits += encodingMap.get(c);
+    }
+    bits += encodingMap.get(PSEUDO_EOF);
+    if (bits != expectedBits) {
+      cout << "testFrequencyMapOrder: codes changed" << endl;
+      return false;
+    }
+
+    // a file counted by several threads keeps the same order: '4' first
+    // occurs late in the second quarter and '^' early in the third and
+    // fourth, so each range's own first positions disagree with the file's
+    // ('4' and '^' share a bucket, so their order shows in keys())
+    string filename = "tests_order.txt";
+    {
+      string data;
+      while (data.size() < (size_t) 4 * COUNT_THREAD_BYTES) {
+        data += text;
+      }
+      data[2 * COUNT_THREAD_BYTES - 100] = '4';
+      data[2 * COUNT_THREAD_BYTES + 100] = '^';
+      data[3 * COUNT_THREAD_BYTES + 50] = '^';
+      ofstream output(filename, ios::binary);
+      output << data;
+    }
+    hashmap oneThread, fourThreads;
+    buildFrequencyMap(filename, true, oneThread, 1);
+    buildFrequencyMap(filename, true, fourThreads, 4);
+    remove(filename.c_str());
+    if (oneThread.keys() != fourThreads.keys()) {
+      cout << "testFrequencyMapOrder: threaded count changed the order" << endl;
+      return false;
+    }
+    cout << "testFrequencyMapOrder: all passed!" << endl;
+    return true;
+}
+
+// Writes text to filename
+void writeFile(string filename, string text) {
+    ofstream output(filename, ios::binary);
+    output << text;
+}
+
+// Returns the contents of filename
+string readFile(string filename) {
+    ifstream input(filename, ios::binary);
+    return string(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+}
+
+// Cut-short files must fail to decompress: a code-length file missing its
+// last byte (and so PSEUDO_EOF), and a frequency-map file whose codes end
+// early.  Block containers must decode with any # of threads.
+bool testDecompressTruncated() {
+    string text;
+    for (int i = 0; i < 2000; i++) {
+      text += "the quick brown fox jumps over the lazy dog " + to_string(i % 97) + "\n";
+    }
+    string half = text.substr(0, text.size() / 2);
+    writeFile("tests_full.txt", text);
+    writeFile("tests_half.txt", half);
+    bool ok = true;
+
+    compressFile("tests_full.txt", "tests.huf", nullptr);
+    string packed = readFile("tests.huf");
+    string decoded;
+    if (!decompressFile("tests.huf", "tests.out", nullptr, &decoded) || decoded != text) {
+      cout << "testDecompressTruncated: good file failed" << endl;
+      ok = false;
+    }
+    writeFile("tests.huf", packed.substr(0, packed.size() - 1));
+    if (ok && decompressFile("tests.huf", "tests.out")) {
+      cout << "testDecompressTruncated: file missing PSEUDO_EOF accepted" << endl;
+      ok = false;
+    }
+
+    // frequency map of the whole text, but only half of it encoded
+    hashmap frequencyMap;
+    buildFrequencyMap("tests_full.txt", true, frequencyMap);
+    HuffmanTree encodingTree = buildEncodingTree(frequencyMap);
+    mymap<int, string> encodingMap = buildEncodingMap(encodingTree);
+    freeTree(encodingTree);
+    {
+      ofbitstream output("tests.huf");
+      ifstream input("tests_half.txt");
+      output << frequencyMap;
+      int size = 0;
+      encode(input, encodingMap, output, size, true);
+    }
+    if (ok && decompressFile("tests.huf", "tests.out")) {
+      cout << "testDecompressTruncated: short frequency-map file accepted" << endl;
+      ok = false;
+    }
+
+    compressBlocks("tests_full.txt", "tests.huf", 1, 4096);
+    for (int threads = 1; ok && threads <= 3; threads++) {
+      decoded.clear();
+      if (!decompressFile("tests.huf", "tests.out", nullptr, &decoded, threads) ||
+          decoded != text) {
+        cout << "testDecompressTruncated: blocks failed with " << threads << " threads" << endl;
+        ok = false;
+      }
+    }
+
+    remove("tests_full.txt");
+    remove("tests_half.txt");
+    remove("tests.huf");
+    remove("tests.out");
+    if (ok) {
+      cout << "testDecompressTruncated: all passed!" << endl;
+    }
+    return ok;
+}
+
+// Overwrites 8 bytes of packed at pos with value, least significant first
+void putU64(string& packed, size_t pos, unsigned long long value) {
+    for (int i = 0; i < 8; i++) {
+      packed[pos + i] = (char) (value >> (8 * i));
+    }
+}
+
+// Block containers with a damaged trailer or index must be rejected, not
+// crash: a block count so large that count * 24 wraps, and index entries
+// whose u64 sizes are negative as long long
+bool testBlockIndexCorrupt() {
+    string text;
+    for (int i = 0; i < 500; i++) {
+      text += "pack my box with five dozen liquor jugs " + to_string(i % 31) + "\n";
+    }
+    writeFile("tests_full.txt", text);
+    compressBlocks("tests_full.txt", "tests.huf", 1, 4096);
+    string packed = readFile("tests.huf");
+    size_t trailer = packed.size() - HUFFMAN_TRAILER_SIZE;
+    unsigned long long indexOffset = 0;
+    for (int i = 0; i < 8; i++) {
+      indexOffset |= (unsigned long long) (unsigned char) packed[trailer + 8 + i] << (8 * i);
+    }
+    bool ok = true;
+    string decoded;
+    if (!decompressFile("tests.huf", "tests.out", nullptr, &decoded) || decoded != text) {
+      cout << "testBlockIndexCorrupt: good file failed" << endl;
+      ok = false;
+    }
+
+    // count * 24 wraps to the real index size: 2^64 / 8 + real count
+    string bad = packed;
+    unsigned long long count = (packed.size() - HUFFMAN_TRAILER_SIZE - indexOffset) / 24;
+    putU64(bad, trailer, (1ULL << 61) + count);
+    writeFile("tests.huf", bad);
+    if (ok && decompressFile("tests.huf", "tests.out")) {
+      cout << "testBlockIndexCorrupt: wrapped block count accepted" << endl;
+      ok = false;
+    }
+
+    // first entry's offset, compressedBytes and rawBytes set negative in turn
+    for (int field = 0; ok && field < 3; field++) {
+      bad = packed;
+      putU64(bad, indexOffset + 8 * field, 0xFFFFFFFFFFFFFF00ULL);
+      writeFile("tests.huf", bad);
+      if (decompressFile("tests.huf", "tests.out")) {
+        cout << "testBlockIndexCorrupt: negative index field " << field << " accepted" << endl;
+        ok = false;
+      }
+    }
+
+    remove("tests_full.txt");
+    remove("tests.huf");
+    remove("tests.out");
+    if (ok) {
+      cout << "testBlockIndexCorrupt: all passed!" << endl;
+    }
+    return ok;
+}
+
+int main() {
+    bool ok = true;
+    ok = testFrequencyMapOrder() && ok;
+    ok = testHashmapIntMin() && ok;
+    ok = testRansCorruptTable() && ok;
+    ok = testDecompressTruncated() && ok;
+    ok = testBlockIndexCorrupt() && ok;
+    return ok ? 0 : 1;
+}
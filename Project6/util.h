@@ -12,71 +12,256 @@
 #include <vector>         // std::vector
 #include <functional>     // std::greater
 #include <string>
+#include <sstream>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <thread>
+#include <cerrno>
+#include <type_traits>
+#include <iterator>
+#include <climits>
 #include "bitstream.h"
 #include "util.h"
 #include "hashmap.h"
 #include "mymap.h"
+#include "mappedfile.h"
+#include "varint.h"
+#include "rans.h"
+#include "lz77.h"
+
+// Position of a node in its HuffmanTree, and the position meaning "none"
+typedef unsigned short HuffmanIndex;
+const HuffmanIndex NO_NODE = 0xffff;
+// A tree over the 256 bytes and PSEUDO_EOF has at most 2 * 257 - 1 nodes
+const int MAX_TREE_NODES = 2 * 257;
 
 struct HuffmanNode {
     int character;
     int count;
-    HuffmanNode* zero;
-    HuffmanNode* one;
+    HuffmanIndex zero;
+    HuffmanIndex one;
+};
+
+//
+// HuffmanTree
+// Every node of one tree in a single array, with children linked by index
+// instead of by pointer.  Building a tree allocates nothing, the nodes sit
+// next to each other for the decoder, copying a tree is a plain memcpy,
+// and freeing one is just resetting it.
+//
+struct HuffmanTree {
+    HuffmanNode nodes[MAX_TREE_NODES];
+    int size;
+    HuffmanIndex root;  // NO_NODE if the tree is empty
+
+    HuffmanTree() : size(0), root(NO_NODE) {
+    }
+
+    //
+    // add
+    // Appends a node and returns its index.
+    //
+    HuffmanIndex add(int character, int count, HuffmanIndex zero, HuffmanIndex one) {
+      if (size == MAX_TREE_NODES) {
+        throw runtime_error("encoding tree has too many nodes");
+      }
+      HuffmanNode& node = nodes[size];
+      node.character = character;
+      node.count = count;
+      node.zero = zero;
+      node.one = one;
+      return (HuffmanIndex) size++;
+    }
+
+    bool empty() const {
+      return root == NO_NODE;
+    }
+
+    const HuffmanNode& operator[](HuffmanIndex index) const {
+      return nodes[index];
+    }
 };
 
-// Prioritize class used for the priority queue
+static_assert(is_trivially_copyable<HuffmanTree>::value,
+              "HuffmanTree is copied with memcpy");
+
+// Prioritize class used for the priority queue of node indices
 class prioritize {
+    private:
+      const HuffmanTree* tree;
     public:
-      bool operator()(const HuffmanNode* h1, const HuffmanNode* h2) const {
-        return h1->count > h2->count;
+      explicit prioritize(const HuffmanTree* tree) : tree(tree) {
+      }
+      bool operator()(HuffmanIndex h1, HuffmanIndex h2) const {
+        return tree->nodes[h1].count > tree->nodes[h2].count;
       }
 };
 
 //
-// *This method frees the memory allocated for the Huffman tree.
+// *This method frees the Huffman tree.  The nodes live inside the tree, so
+// this only marks it empty.
 //
-void freeTree(HuffmanNode* node) {
-    // Base Case: null node
-    if (node == nullptr) {
-      return;
+void freeTree(HuffmanTree& tree) {
+    tree.size = 0;
+    tree.root = NO_NODE;
+}
+
+// Smallest share of a file worth giving its own counting thread
+const int COUNT_THREAD_BYTES = 1 << 20;
+
+//
+// *This function adds how many times each byte occurs in data to counts.
+// It keeps four count tables and spreads consecutive bytes across them,
+// so runs of the same byte do not all wait on a single counter, and reads
+// the data eight bytes at a time.  If first is not null, first[b] is set
+// to the position in data where b first occurs, for every byte b that
+// occurs in data and had a count of 0 before.
+//
+void countBytes(const char* data, size_t n, long long counts[256], size_t* first = nullptr) {
+    const unsigned char* p = (const unsigned char*) data;
+    size_t offset = 0;
+    while (n > 0) {
+      // 32-bit counters cannot overflow within 2^30 bytes
+      size_t chunk = min(n, (size_t) 1 << 30);
+      unsigned int c0[256] = {0}, c1[256] = {0}, c2[256] = {0}, c3[256] = {0};
+      size_t i = 0;
+      for (; i + 8 <= chunk; i += 8) {
+        unsigned long long w;
+        memcpy(&w, p + i, 8);
+        c0[w & 0xff]++;
+        c1[(w >> 8) & 0xff]++;
+        c2[(w >> 16) & 0xff]++;
+        c3[(w >> 24) & 0xff]++;
+        c0[(w >> 32) & 0xff]++;
+        c1[(w >> 40) & 0xff]++;
+        c2[(w >> 48) & 0xff]++;
+        c3[w >> 56]++;
+      }
+      for (; i < chunk; i++) {
+        c0[p[i]]++;
+      }
+      bool isNew[256] = {false};
+      int nNew = 0;
+      for (int b = 0; b < 256; b++) {
+        long long count = (long long) c0[b] + c1[b] + c2[b] + c3[b];
+        if (count > 0 && counts[b] == 0) {
+          isNew[b] = true;
+          nNew++;
+        }
+        counts[b] += count;
+      }
+      // Only bytes new to counts need a position, so the scan stops as
+      // soon as the last of them is found, usually near the start
+      for (size_t j = 0; first != nullptr && nNew > 0; j++) {
+        if (isNew[p[j]]) {
+          isNew[p[j]] = false;
+          first[p[j]] = offset + j;
+          nNew--;
+        }
+      }
+      p += chunk;
+      n -= chunk;
+      offset += chunk;
     }
+}
 
-    // Recursive calls to both children nodes
-    freeTree(node->zero);
-    freeTree(node->one);
+//
+// *This function sets counts to the byte frequencies of the file filename,
+// scanning it through a mappedfile.  With numThreads > 1 the data is split
+// into that many ranges that are counted at the same time.  If first is
+// not null, first[b] is set to the position in the file where b first
+// occurs, for every byte b that occurs.  Returns false if the file cannot
+// be opened.
+//
+bool countFile(string filename, long long counts[256], int numThreads = 1,
+               size_t* first = nullptr) {
+    for (int b = 0; b < 256; b++) {
+      counts[b] = 0;
+    }
+    mappedfile input(filename);
+    if (!input.is_open()) {
+      return false;
+    }
+    size_t size = input.size();
+    if (numThreads < 1 || size < (size_t) COUNT_THREAD_BYTES * numThreads) {
+      numThreads = 1;
+    }
+
+    // Each thread counts its own range into its own tables
+    vector<vector<long long>> partial(numThreads, vector<long long>(256, 0));
+    vector<vector<size_t>> partialFirst(numThreads, vector<size_t>(256, 0));
+    auto rangeBegin = [&](int t) {
+      return size / numThreads * t;
+    };
+    auto countRange = [&](int t) {
+      size_t begin = rangeBegin(t);
+      size_t end = (t == numThreads - 1) ? size : rangeBegin(t + 1);
+      countBytes(input.data() + begin, end - begin, partial[t].data(),
+                 first != nullptr ? partialFirst[t].data() : nullptr);
+    };
 
-    // delete current node
-    delete node;
+    vector<thread> threads;
+    for (int t = 1; t < numThreads; t++) {
+      threads.emplace_back(countRange, t);
+    }
+    countRange(0);
+    for (auto& th : threads) {
+      th.join();
+    }
+    // The ranges are in file order, so the first range with a byte holds
+    // its first position
+    for (int t = 0; t < numThreads; t++) {
+      for (int b = 0; b < 256; b++) {
+        if (first != nullptr && counts[b] == 0 && partial[t][b] > 0) {
+          first[b] = rangeBegin(t) + partialFirst[t][b];
+        }
+        counts[b] += partial[t][b];
+      }
+    }
+    return true;
 }
 
 //
 // *This function build the frequency map.  If isFile is true, then it reads
 // from filename.  If isFile is false, then it reads from a string filename.
 //
-void buildFrequencyMap(string filename, bool isFile, hashmap &map) {
+// The bytes are counted into arrays first (see countBytes) and the map is
+// only touched once per distinct byte.  numThreads is passed to countFile.
+// The bytes are added in the order they first occur, as reading one char
+// at a time would add them, since the map's key order decides how the
+// encoding tree breaks ties.  The map and the tree hold int counts, and
+// the header must keep the true counts, so input with more than INT_MAX - 1
+// bytes throws instead of being scaled.
+//
+void buildFrequencyMap(string filename, bool isFile, hashmap &map, int numThreads = 1) {
+    long long counts[256] = {0};
+    size_t first[256];
     if (isFile) {
-      ifstream inFS(filename);
-      char c;
-      // Read each character from the stream
-      while (inFS.get(c)) {
-        // If character is already in map, increment its count
-        if (map.containsKey(c)) {
-          map.put(c, map.get(c)+1);
-        } else {
-          // Otherwise, add the character to the map
-          map.put(c, 1);
-        }
-      }
+      countFile(filename, counts, numThreads, first);
     } else {
-      // If input is a string, loop through each character and do the same as before
-      for (char& c : filename) {
-        if (map.containsKey(c)) {
-          map.put(c, map.get(c)+1);
-        } else {
-          map.put(c, 1);
-        }
+      countBytes(filename.data(), filename.size(), counts, first);
+    }
+    vector<int> order;
+    long long total = 0;
+    for (int b = 0; b < 256; b++) {
+      if (counts[b] > 0) {
+        order.push_back(b);
+        total += counts[b];
       }
     }
+    // the tree's root counts every byte plus PSEUDO_EOF
+    if (total > INT_MAX - 1) {
+      throw runtime_error("input too large for the frequency map (over 2 GB); "
+                          "use the command line to compress it");
+    }
+    sort(order.begin(), order.end(), [&](int a, int b) {
+      return first[a] < first[b];
+    });
+    // Add each byte's count to the map, keyed the way a char reads
+    for (int b : order) {
+      map.add((int) (char) b, (int) counts[b]);
+    }
     // Add PSEUDO_EOF to the map
     map.put(PSEUDO_EOF, 1);
 }
@@ -84,67 +269,439 @@ void buildFrequencyMap(string filename, bool isFile, hashmap &map) {
 //
 // *This function builds an encoding tree from the frequency map.
 //
-HuffmanNode* buildEncodingTree(hashmap &map) {
-    // Initialize priority_queue of HuffmanNodes
-    priority_queue<HuffmanNode*, vector<HuffmanNode*>, prioritize> pq;
-    vector<int> keys = map.keys();
+HuffmanTree buildEncodingTree(hashmap &map) {
+    HuffmanTree tree;
+    // Initialize priority_queue of HuffmanNodes (by their index in the tree)
+    priority_queue<HuffmanIndex, vector<HuffmanIndex>, prioritize> pq((prioritize(&tree)));
 
-    // For every character in the map, create a new node and push it into the queue
-    for (size_t i = 0; i < keys.size(); i++) {
-      HuffmanNode* newNode = new HuffmanNode;
-      newNode->character = keys[i];
-      newNode->count = map.get(keys[i]);
-      newNode->zero = nullptr;
-      newNode->one = nullptr;
-      pq.push(newNode);
-    }
+    // For every character in the map, create a new node and push it into the
+    // queue (in keys() order, which breaks ties between equal counts)
+    map.for_each([&](int key, int count) {
+      pq.push(tree.add(key, count, NO_NODE, NO_NODE));
+    });
 
     while (pq.size() > 1) {
       // Pop the first two nodes off the queue
-      HuffmanNode* first = pq.top();
+      HuffmanIndex first = pq.top();
       pq.pop();
-      HuffmanNode* second = pq.top();
+      HuffmanIndex second = pq.top();
       pq.pop();
-      // Create a new node with the two nodes as its children
-      HuffmanNode* newNode = new HuffmanNode;
-      newNode->character = NOT_A_CHAR;
-      newNode->count = first->count + second->count;
-      newNode->zero = first;
-      newNode->one = second;
-      // Push the new node back onto the queue
-      pq.push(newNode);
+      // Create a new node with the two nodes as its children, and push it
+      // back onto the queue
+      int count = tree[first].count + tree[second].count;
+      pq.push(tree.add(NOT_A_CHAR, count, first, second));
     }
 
     // When size of queue = 1, that node is the root of the entire tree
-    HuffmanNode* root = pq.top();
-    return root;
+    if (!pq.empty()) {
+      tree.root = pq.top();
+    }
+    return tree;
 }
 
-void buildMap(HuffmanNode* node, mymap<int, string>& m, string s) {
-    // Base Case: return if node is null
-    if (node == nullptr) {
+void buildMap(const HuffmanTree& tree, HuffmanIndex node, mymap<int, string>& m, string s) {
+    // Base Case: return if there is no node
+    if (node == NO_NODE) {
       return;
     }
     // If the node contains a character, add it to the map
-    if (node->character != NOT_A_CHAR) {
-      m.put(node->character, s);
+    if (tree[node].character != NOT_A_CHAR) {
+      m.put(tree[node].character, s);
     }
     // Recursive calls to both children nodes
-    buildMap(node->zero, m, s + "0");
-    buildMap(node->one, m, s + "1");
+    buildMap(tree, tree[node].zero, m, s + "0");
+    buildMap(tree, tree[node].one, m, s + "1");
 }
 
 //
 // *This function builds the encoding map from an encoding tree.
 //
-mymap <int, string> buildEncodingMap(HuffmanNode* tree) {
+mymap <int, string> buildEncodingMap(const HuffmanTree& tree) {
     mymap <int, string> encodingMap;
 
-    buildMap(tree, encodingMap, "");
+    buildMap(tree, tree.root, encodingMap, "");
 
     return encodingMap;
 }
 
+// Number of symbols a code can be assigned: the 256 byte values plus
+// PSEUDO_EOF
+const int NUM_SYMBOLS = 257;
+
+// First bytes of a compressed file with a code-length header.  Files
+// that start with '{' instead have the original frequency map header.
+const char HUFFMAN_MAGIC[4] = {'\x89', 'H', 'U', 'F'};
+const int HUFFMAN_VERSION = 1;
+
+//
+// *This function returns the 0..256 index of a character: the unsigned
+// byte value, or 256 for PSEUDO_EOF.
+//
+int symbolIndex(int character) {
+    return (character == PSEUDO_EOF) ? 256 : (unsigned char) character;
+}
+
+//
+// *This function is the inverse of symbolIndex.  Bytes come back as signed
+// chars, the same keys buildFrequencyMap uses.
+//
+int symbolCharacter(int index) {
+    return (index == 256) ? PSEUDO_EOF : (int) (char) index;
+}
+
+void findLengths(const HuffmanTree& tree, HuffmanIndex node, unsigned char lengths[], int depth) {
+    // Base Case: return if there is no node
+    if (node == NO_NODE) {
+      return;
+    }
+    // If the node contains a character, its depth is its code length
+    if (tree[node].character != NOT_A_CHAR) {
+      lengths[symbolIndex(tree[node].character)] = depth;
+    }
+    // Recursive calls to both children nodes
+    findLengths(tree, tree[node].zero, lengths, depth + 1);
+    findLengths(tree, tree[node].one, lengths, depth + 1);
+}
+
+//
+// *This function fills lengths with the code length of every symbol in
+// the encoding tree (0 for symbols that are not in the tree).
+//
+void buildCodeLengths(const HuffmanTree& tree, unsigned char lengths[NUM_SYMBOLS]) {
+    for (int i = 0; i < NUM_SYMBOLS; i++) {
+      lengths[i] = 0;
+    }
+    // A tree that is a single leaf has no codes at all
+    if (!tree.empty() && tree[tree.root].character == NOT_A_CHAR) {
+      findLengths(tree, tree.root, lengths, 0);
+    }
+}
+
+//
+// *This function builds the canonical encoding tree for the given code
+// lengths.  Symbols are given codes in order of (length, symbol index),
+// each code being the previous one plus one, shifted left when the length
+// grows.  Only the lengths are needed to rebuild the same codes, which is
+// what lets the header store nothing else.  Node counts are left at 0.
+//
+HuffmanTree buildCanonicalTree(const unsigned char lengths[NUM_SYMBOLS]) {
+    HuffmanTree tree;
+    tree.root = tree.add(NOT_A_CHAR, 0, NO_NODE, NO_NODE);
+
+    // Order the symbols by (length, index)
+    vector<int> order;
+    for (int len = 1; len < 256; len++) {
+      for (int i = 0; i < NUM_SYMBOLS; i++) {
+        if (lengths[i] == len) {
+          order.push_back(i);
+        }
+      }
+    }
+    // No codes (empty file): the root is just the PSEUDO_EOF leaf
+    if (order.empty()) {
+      tree.nodes[tree.root].character = PSEUDO_EOF;
+      return tree;
+    }
+
+    // Codes can be longer than 64 bits, so the code is kept as a string
+    string code = "";
+    for (size_t k = 0; k < order.size(); k++) {
+      int len = lengths[order[k]];
+      if (k > 0) {
+        // add one to the previous code
+        int pos = code.size() - 1;
+        while (pos >= 0 && code[pos] == '1') {
+          code[pos--] = '0';
+        }
+        if (pos < 0) {
+          throw runtime_error("invalid code lengths");
+        }
+        code[pos] = '1';
+      }
+      code.append(len - code.size(), '0');
+
+      // Walk down the path of the code, creating nodes as needed
+      HuffmanIndex cur = tree.root;
+      for (char bit : code) {
+        HuffmanIndex next = (bit == '0') ? tree[cur].zero : tree[cur].one;
+        if (next == NO_NODE) {
+          next = tree.add(NOT_A_CHAR, 0, NO_NODE, NO_NODE);
+          if (bit == '0') {
+            tree.nodes[cur].zero = next;
+          } else {
+            tree.nodes[cur].one = next;
+          }
+        }
+        cur = next;
+      }
+      tree.nodes[cur].character = symbolCharacter(order[k]);
+    }
+    // A complete code ends on all ones; anything else would leave
+    // internal nodes with a missing child
+    if (code.find('0') != string::npos) {
+      throw runtime_error("invalid code lengths");
+    }
+    return tree;
+}
+
+//
+// *This function writes a code-length table: a 256-bit map of which bytes
+// have a code, the PSEUDO_EOF code length, then one length byte per byte
+// that has a code.
+//
+void writeLengthTable(ostream& output, const unsigned char lengths[NUM_SYMBOLS]) {
+    unsigned char present[32] = {0};
+    for (int i = 0; i < 256; i++) {
+      if (lengths[i] != 0) {
+        present[i / 8] |= 1 << (i % 8);
+      }
+    }
+    output.write((const char*) present, 32);
+    output.put((char) lengths[256]);
+    for (int i = 0; i < 256; i++) {
+      if (lengths[i] != 0) {
+        output.put((char) lengths[i]);
+      }
+    }
+}
+
+//
+// *This function reads a code-length table written by writeLengthTable.
+//
+bool readLengthTable(istream& input, unsigned char lengths[NUM_SYMBOLS]) {
+    unsigned char present[32];
+    if (!input.read((char*) present, 32)) {
+      return false;
+    }
+    lengths[256] = (unsigned char) input.get();
+    for (int i = 0; i < 256; i++) {
+      lengths[i] = (present[i / 8] >> (i % 8)) & 1 ? (unsigned char) input.get() : 0;
+    }
+    return !input.fail();
+}
+
+//
+// *This function writes the code-length header: the magic bytes, the
+// version, then the code-length table.
+//
+void writeCodeLengths(ostream& output, const unsigned char lengths[NUM_SYMBOLS]) {
+    output.write(HUFFMAN_MAGIC, 4);
+    output.put((char) HUFFMAN_VERSION);
+    writeLengthTable(output, lengths);
+}
+
+//
+// *This function reads the code-length header written by writeCodeLengths.
+// Returns false if the input does not start with a valid header.
+//
+bool readCodeLengths(istream& input, unsigned char lengths[NUM_SYMBOLS]) {
+    char magic[4];
+    if (!input.read(magic, 4) || memcmp(magic, HUFFMAN_MAGIC, 4) != 0 ||
+        input.get() != HUFFMAN_VERSION) {
+      return false;
+    }
+    return readLengthTable(input, lengths);
+}
+
+// Size of the chunks read from the input and written to the output
+const int ENCODE_BUFFER_SIZE = 1 << 16;
+
+//
+// One entry of the flat encoding table.  The first bit of the code is in
+// the lowest position of bits, which is the order ofbitstream writes them.
+//
+struct HuffmanCode {
+    unsigned long long bits;
+    int length;
+};
+
+void findCodes(const HuffmanTree& tree, HuffmanIndex node, HuffmanCode table[],
+               unsigned long long bits, int length) {
+    // Base Case: return if there is no node
+    if (node == NO_NODE) {
+      return;
+    }
+    // If the node contains a character, add its code to the table
+    int character = tree[node].character;
+    if (character != NOT_A_CHAR) {
+      table[symbolIndex(character)].bits = bits;
+      table[symbolIndex(character)].length = length;
+      return;
+    }
+    if (length >= 64) {
+      throw runtime_error("code longer than 64 bits");
+    }
+    // Recursive calls to both children nodes
+    findCodes(tree, tree[node].zero, table, bits, length + 1);
+    findCodes(tree, tree[node].one, table, bits | (1ULL << length), length + 1);
+}
+
+//
+// *This function builds the flat encoding table (indexed by symbolIndex)
+// from an encoding tree.  Symbols not in the tree get length 0.
+//
+void buildEncodingTable(const HuffmanTree& tree, HuffmanCode table[NUM_SYMBOLS]) {
+    for (int i = 0; i < NUM_SYMBOLS; i++) {
+      table[i].bits = 0;
+      table[i].length = 0;
+    }
+    findCodes(tree, tree.root, table, 0, 0);
+}
+
+//
+// *This function builds the flat encoding table from an encoding map of
+// '0'/'1' strings.
+//
+void buildEncodingTable(mymap <int, string> &encodingMap, HuffmanCode table[NUM_SYMBOLS]) {
+    for (int i = 0; i < NUM_SYMBOLS; i++) {
+      table[i].bits = 0;
+      table[i].length = 0;
+    }
+    // Look each symbol up rather than walk the map, which only needs the
+    // same contains/get the original encoder used
+    for (int i = 0; i < NUM_SYMBOLS; i++) {
+      int key = symbolCharacter(i);
+      if (!encodingMap.contains(key)) {
+        continue;
+      }
+      string code = encodingMap.get(key);
+      if (code.size() > 64) {
+        throw runtime_error("code longer than 64 bits");
+      }
+      HuffmanCode& entry = table[i];
+      for (size_t i = 0; i < code.size(); i++) {
+        if (code[i] == '1') {
+          entry.bits |= 1ULL << i;
+        }
+      }
+      entry.length = code.size();
+    }
+}
+
+//
+// bitWriter
+// Collects codes in a 64-bit register and writes whole 8-byte words to a
+// buffer, which goes to the output stream 64 KB at a time.  The bits come
+// out in the same order as ofbitstream::writeBit would write them, and
+// finish() pads the last byte with zeros the same way.  A null output
+// just counts the bits.
+//
+class bitWriter {
+ private:
+    ostream* output;
+    unsigned long long acc;  // pending bits, oldest in the lowest position
+    int count;               // # of pending bits
+    vector<char> buffer;
+    size_t used;
+    long long total;
+
+    void putWord(unsigned long long word, int nBytes) {
+      for (int i = 0; i < nBytes; i++) {
+        buffer[used++] = (char) (word >> (8 * i));
+      }
+      if (used + 8 > buffer.size()) {
+        flushBuffer();
+      }
+    }
+
+    void flushBuffer() {
+      if (output != nullptr) {
+        output->write(buffer.data(), used);
+      }
+      used = 0;
+    }
+
+ public:
+    explicit bitWriter(ostream* output)
+      : output(output), acc(0), count(0), buffer(ENCODE_BUFFER_SIZE), used(0), total(0) {
+    }
+
+    //
+    // write
+    // Appends the low length bits of bits (length <= 64).
+    //
+    void write(unsigned long long bits, int length) {
+      total += length;
+      if (count + length < 64) {
+        acc |= bits << count;
+        count += length;
+        return;
+      }
+      // The register fills up: write it and keep the bits that did not fit
+      int room = 64 - count;
+      acc |= bits << count;
+      putWord(acc, 8);
+      acc = (room < 64) ? bits >> room : 0;
+      count = length - room;
+    }
+
+    //
+    // finish
+    // Writes the pending bits, padding the last byte with zeros.
+    //
+    void finish() {
+      putWord(acc, (count + 7) / 8);
+      flushBuffer();
+      acc = 0;
+      count = 0;
+    }
+
+    long long bitsWritten() const {
+      return total;
+    }
+};
+
+void appendBitString(const HuffmanCode& code, string* bitString) {
+    for (int i = 0; i < code.length; i++) {
+      *bitString += ((code.bits >> i) & 1) ? '1' : '0';
+    }
+}
+
+//
+// *This function writes the codes of n bytes of data to writer.  If
+// bitString is not null, the bits are also appended to it as '0'/'1'
+// characters.
+//
+void encodeBytes(const char* data, size_t n, const HuffmanCode table[NUM_SYMBOLS],
+                 bitWriter& writer, string* bitString) {
+    for (size_t i = 0; i < n; i++) {
+      const HuffmanCode& code = table[(unsigned char) data[i]];
+      if (code.length == 0) {
+        throw runtime_error("byte has no code in the encoding table");
+      }
+      writer.write(code.bits, code.length);
+      if (bitString != nullptr) {
+        appendBitString(code, bitString);
+      }
+    }
+}
+
+//
+// *This function encodes the input stream into output (which may be null)
+// using the flat encoding table, followed by PSEUDO_EOF, and returns the
+// number of bits written.  If bitString is not null, the bits are also
+// appended to it as '0'/'1' characters.
+//
+long long encodeBits(istream& input, const HuffmanCode table[NUM_SYMBOLS],
+                     ostream* output, string* bitString) {
+    bitWriter writer(output);
+    vector<char> inBuf(ENCODE_BUFFER_SIZE);
+    streambuf* in = input.rdbuf();
+    streamsize n;
+
+    while ((n = in->sgetn(inBuf.data(), ENCODE_BUFFER_SIZE)) > 0) {
+      encodeBytes(inBuf.data(), n, table, writer, bitString);
+    }
+    // Add PSEUDO_EOF to the end of the output
+    writer.write(table[256].bits, table[256].length);
+    if (bitString != nullptr) {
+      appendBitString(table[256], bitString);
+    }
+    writer.finish();
+
+    return writer.bitsWritten();
+}
+
 //
 // *This function encodes the data in the input stream into the output stream
 // using the encodingMap.  This function calculates the number of bits
@@ -154,63 +711,226 @@ mymap <int, string> buildEncodingMap(HuffmanNode* tree) {
 //
 string encode(ifstream& input, mymap <int, string> &encodingMap,
               ofbitstream& output, int &size, bool makeFile) {
-    char c;
+    HuffmanCode table[NUM_SYMBOLS];
+    buildEncodingTable(encodingMap, table);
+
     string str = "";
+    long long bits = encodeBits(input, table, makeFile ? &output : nullptr, &str);
+    if (makeFile) {
+      size += bits;
+    }
 
-    string segment;
-    // Get each character from the input
-    while (input.get(c)) {
-      // Get the corresponding string from the map and add it to str
-      segment = encodingMap.get(c);
-      str += segment;
-      if (makeFile) {
-        // When writing to an output, loop through segment and add each bit to the output
-        for (char& c : segment) {
-          if (c == '1') {
-            output.writeBit(1);
-            size++;
-          } else {
-            output.writeBit(0);
-            size++;
+    return str;
+}
+
+// Number of bits the table decoder looks up at once.  Codes up to this
+// long are resolved with one lookup; longer codes finish with a tree walk.
+const int DECODE_TABLE_BITS = 11;
+// Most bytes a single table entry can decode
+const int DECODE_MAX_SYMBOLS = 3;
+// Size of the chunks read from the input and written to the output
+const int DECODE_BUFFER_SIZE = 1 << 16;
+
+//
+// One entry of the decoding table.  The entry for an index holds what
+// the tree walk would decode from those DECODE_TABLE_BITS bits (first bit
+// in the lowest position, the order ifbitstream uses).
+//
+struct HuffmanDecodeEntry {
+    unsigned char count;   // # of bytes decoded by this entry
+    unsigned char bits;    // # of bits used by those bytes (and the EOF)
+    bool eof;              // PSEUDO_EOF follows the decoded bytes
+    unsigned char bytes[DECODE_MAX_SYMBOLS];
+    HuffmanIndex node;     // code longer than the table: node reached so far
+};
+
+//
+// *This function builds the decoding table from an encoding tree.  table
+// must have room for 1 << DECODE_TABLE_BITS entries.
+//
+void buildDecodeTable(const HuffmanTree& tree, HuffmanDecodeEntry* table) {
+    for (int index = 0; index < (1 << DECODE_TABLE_BITS); index++) {
+      HuffmanDecodeEntry& e = table[index];
+      e.count = 0;
+      e.bits = 0;
+      e.eof = false;
+      e.node = NO_NODE;
+
+      // Walk the tree with the bits of index, keeping every whole code
+      HuffmanIndex cur = tree.root;
+      for (int b = 0; b < DECODE_TABLE_BITS; b++) {
+        cur = ((index >> b) & 1) ? tree[cur].one : tree[cur].zero;
+        int character = tree[cur].character;
+        if (character != NOT_A_CHAR) {
+          e.bits = b + 1;
+          if (character == PSEUDO_EOF) {
+            e.eof = true;
+            break;
           }
+          e.bytes[e.count++] = (unsigned char) character;
+          if (e.count == DECODE_MAX_SYMBOLS) {
+            break;
+          }
+          cur = tree.root;
         }
       }
+
+      // No whole code fit, so remember where the walk stopped
+      if (e.count == 0 && !e.eof) {
+        e.bits = DECODE_TABLE_BITS;
+        e.node = cur;
+      }
     }
-    // Add PSEUDO_EOF to the end of the string and output
-    segment = encodingMap.get(PSEUDO_EOF);
-    str += segment;
-    if (makeFile) {
-      for (char& c : segment) {
-        if (c == '1') {
-          output.writeBit(1);
-          size++;
-        } else {
-          output.writeBit(0);
-          size++;
+}
+
+//
+// *This function decodes the bits in the input stream (up to PSEUDO_EOF)
+// into output using the encodingTree, and returns the number of bytes
+// written.  If text is not null, the bytes are also appended to it.  If
+// complete is not null, it is set to whether PSEUDO_EOF was reached, which
+// it is not when the input is cut short.
+//
+// The bits are read a byte buffer at a time into a 64-bit bit buffer, and
+// DECODE_TABLE_BITS of them are decoded per table lookup.
+//
+long long decodeBits(istream& input, const HuffmanTree& encodingTree,
+                     ostream& output, string* text, bool* complete = nullptr) {
+    long long written = 0;
+    if (complete != nullptr) {
+      *complete = !encodingTree.empty();
+    }
+    // A tree with only PSEUDO_EOF in it encodes an empty file
+    if (encodingTree.empty() || encodingTree[encodingTree.root].character != NOT_A_CHAR) {
+      return written;
+    }
+    const HuffmanNode* nodes = encodingTree.nodes;
+
+    vector<HuffmanDecodeEntry> table(1 << DECODE_TABLE_BITS);
+    buildDecodeTable(encodingTree, table.data());
+    const unsigned long long mask = (1ULL << DECODE_TABLE_BITS) - 1;
+
+    // The header has already been read, so the bits start at the next byte
+    streambuf* in = input.rdbuf();
+    vector<char> inBuf(DECODE_BUFFER_SIZE);
+    streamsize inPos = 0, inLen = 0;
+    unsigned long long bitBuf = 0;
+    int bitCount = 0;
+
+    vector<char> outBuf(DECODE_BUFFER_SIZE);
+    size_t outLen = 0;
+
+    // Tops the bit buffer up to at least 57 bits, unless the input runs out
+    auto refill = [&]() {
+      while (bitCount <= 56) {
+        if (inPos == inLen) {
+          inLen = in->sgetn(inBuf.data(), DECODE_BUFFER_SIZE);
+          inPos = 0;
+          if (inLen <= 0) {
+            inLen = 0;
+            return;
+          }
+        }
+        bitBuf |= (unsigned long long) (unsigned char) inBuf[inPos++] << bitCount;
+        bitCount += 8;
+      }
+    };
+
+    auto flush = [&]() {
+      output.write(outBuf.data(), outLen);
+      if (text != nullptr) {
+        text->append(outBuf.data(), outLen);
+      }
+      written += outLen;
+      outLen = 0;
+    };
+
+    // Finishes a code one bit at a time starting from node cur.  Returns
+    // the character, or NOT_A_CHAR if the input ends first.
+    auto walk = [&](HuffmanIndex cur) {
+      while (nodes[cur].character == NOT_A_CHAR) {
+        if (bitCount == 0) {
+          refill();
+          if (bitCount == 0) {
+            return (int) NOT_A_CHAR;
+          }
+        }
+        cur = (bitBuf & 1) ? nodes[cur].one : nodes[cur].zero;
+        bitBuf >>= 1;
+        bitCount--;
+      }
+      return nodes[cur].character;
+    };
+
+    while (true) {
+      refill();
+      if (outLen + DECODE_MAX_SYMBOLS > outBuf.size()) {
+        flush();
+      }
+
+      const HuffmanDecodeEntry& e = table[bitBuf & mask];
+      int character;
+      if (e.bits <= bitCount && e.node == NO_NODE) {
+        // Whole codes: copy the bytes and stop if the EOF was among them
+        for (int i = 0; i < e.count; i++) {
+          outBuf[outLen++] = e.bytes[i];
+        }
+        bitBuf >>= e.bits;
+        bitCount -= e.bits;
+        if (!e.eof) {
+          continue;
+        }
+        character = PSEUDO_EOF;
+      } else if (e.node != NO_NODE && bitCount >= DECODE_TABLE_BITS) {
+        // Long code: skip the bits the table already followed
+        bitBuf >>= DECODE_TABLE_BITS;
+        bitCount -= DECODE_TABLE_BITS;
+        character = walk(e.node);
+      } else {
+        // Fewer bits left than the entry needs: finish bit by bit
+        character = walk(encodingTree.root);
+      }
+
+      // If cur contains PSEUDO_EOF (or the input ended), the loop ends
+      if (character == PSEUDO_EOF || character == NOT_A_CHAR) {
+        if (complete != nullptr) {
+          *complete = (character == PSEUDO_EOF);
         }
+        break;
       }
+      outBuf[outLen++] = (char) character;
     }
+    flush();
 
-    return str;
+    return written;
 }
 
-
 //
 // *This function decodes the input stream and writes the result to the output
 // stream using the encodingTree.  This function also returns a string
 // representation of the output file, which is particularly useful for testing.
 //
-string decode(ifbitstream &input, HuffmanNode* encodingTree, ofstream &output) {
+string decode(ifbitstream &input, const HuffmanTree& encodingTree, ofstream &output) {
+    string result = "";
+    decodeBits(input, encodingTree, output, &result);
+    return result;
+}
+
+//
+// *This function decodes the input stream one bit at a time by walking the
+// encodingTree.  It is the original decoder, kept as the reference the
+// table decoder is benchmarked and checked against.
+//
+string decodeTreeWalk(ifbitstream &input, const HuffmanTree& encodingTree, ofstream &output) {
     string result = "";
-    HuffmanNode* cur = encodingTree;
+    const HuffmanNode* cur = &encodingTree[encodingTree.root];
     // Read each bit from the input
     while (!input.eof()) {
       int bit = input.readBit();
       // If the bit is 0, set cur to the zero child. Otherwise, set it to the one child
       if (bit == 0) {
-        cur = cur->zero;
+        cur = &encodingTree[cur->zero];
       } else {
-        cur = cur->one;
+        cur = &encodingTree[cur->one];
       }
       // If cur contains a character, write that character to the output
       if (cur->character != NOT_A_CHAR) {
@@ -220,44 +940,1158 @@ string decode(ifbitstream &input, HuffmanNode* encodingTree, ofstream &output) {
         }
         result += cur->character;
         output.put(cur->character);
-        cur = encodingTree;
+        cur = &encodingTree[encodingTree.root];
       }
     }
 
     return result;
 }
 
+// Sizes reported by compressFile and decompressFile
+struct HuffmanStats {
+    long long inputBytes;
+    long long outputBytes;
+    long long headerBytes;
+};
+
 //
-// *This function completes the entire compression process.  Given a file,
-// filename, this function (1) builds a frequency map; (2) builds an encoding
-// tree; (3) builds an encoding map; (4) encodes the file (don't forget to
-// include the frequency map in the header of the output file).  This function
-// should create a compressed file named (filename + ".huf") and should also
-// return a string version of the bit pattern.
+// *This function reads the header of a compressed file and returns the
+// encoding tree it describes, leaving input at the first encoded bit.
+// Files with the original frequency map header get the tree rebuilt from
+// the map; files with a code-length header get the canonical tree.
+// Returns an empty tree if the header is not valid.  If expectedBytes is
+// not null, it is set to the decoded size the frequency map adds up to,
+// or -1 for a code-length header, which does not record it.
 //
-string compress(string filename) {
-    ofbitstream output(filename + ".huf");
-    hashmap frequencyMap;
-    // build the frequency Map
-    buildFrequencyMap(filename, true, frequencyMap);
-    // build the encoding tree
-    HuffmanNode* root = buildEncodingTree(frequencyMap);
-    // build the encoding map
-    mymap<int, string> encodingMap = buildEncodingMap(root);
-    // Use the frequencyMap to add the header of the output file
-    output << frequencyMap;
-    ifstream input(filename);
-
-    int size = 0;
-    // encode the file
-    string result = encode(input, encodingMap, output, size, true);
-    // Free the allocated memory
-    freeTree(root);
-
-    return result;
+HuffmanTree readEncodingTree(istream& input, long long* expectedBytes = nullptr) {
+    if (expectedBytes != nullptr) {
+      *expectedBytes = -1;
+    }
+    if (input.peek() == '{') {
+      hashmap frequencyMap;
+      input >> frequencyMap;
+      if (expectedBytes != nullptr) {
+        *expectedBytes = 0;
+        frequencyMap.for_each([&](int key, int value) {
+          *expectedBytes += (key == PSEUDO_EOF) ? 0 : value;
+        });
+      }
+      return buildEncodingTree(frequencyMap);
+    }
+    unsigned char lengths[NUM_SYMBOLS];
+    if (!readCodeLengths(input, lengths)) {
+      return HuffmanTree();
+    }
+    return buildCanonicalTree(lengths);
 }
 
-//
+// Version byte of the block container: the input is split into blocks
+// that are compressed independently, each with its own code-length table,
+// and an index of the blocks is stored at the end of the file
+const int HUFFMAN_BLOCK_VERSION = 2;
+// Default # of input bytes per block
+const int DEFAULT_BLOCK_SIZE = 1 << 22;
+// Last bytes of a block container
+const char HUFFMAN_INDEX_MAGIC[4] = {'H', 'I', 'D', 'X'};
+// Bytes after the index: block count, index offset, magic
+const int HUFFMAN_TRAILER_SIZE = 20;
+
+// One entry of the block index
+struct HuffmanBlockInfo {
+    long long offset;           // file position of the block
+    long long compressedBytes;  // size of the block in the file
+    long long rawBytes;         // size of the block once decompressed
+};
+
+void writeU64(ostream& output, unsigned long long value) {
+    char bytes[8];
+    for (int i = 0; i < 8; i++) {
+      bytes[i] = (char) (value >> (8 * i));
+    }
+    output.write(bytes, 8);
+}
+
+unsigned long long readU64(istream& input) {
+    unsigned char bytes[8] = {0};
+    input.read((char*) bytes, 8);
+    unsigned long long value = 0;
+    for (int i = 0; i < 8; i++) {
+      value |= (unsigned long long) bytes[i] << (8 * i);
+    }
+    return value;
+}
+
+//
+// memoryBuffer
+// A read-only streambuf over bytes already in memory (a block, or a whole
+// mapped file), so they can be handed to the stream-based header reader
+// and decoder without copying them.  Supports seekg and tellg.
+//
+class memoryBuffer : public streambuf {
+ protected:
+    pos_type seekoff(off_type off, ios_base::seekdir dir,
+                     ios_base::openmode which = ios_base::in) override {
+      char* base = dir == ios_base::beg ? eback() : dir == ios_base::cur ? gptr() : egptr();
+      if (!(which & ios_base::in) || base + off < eback() || base + off > egptr()) {
+        return pos_type(off_type(-1));
+      }
+      setg(eback(), base + off, egptr());
+      return pos_type(base + off - eback());
+    }
+
+    pos_type seekpos(pos_type pos, ios_base::openmode which = ios_base::in) override {
+      return seekoff(off_type(pos), ios_base::beg, which);
+    }
+
+ public:
+    memoryBuffer(const char* data, size_t n) {
+      char* p = const_cast<char*>(data);
+      setg(p, p, p + n);
+    }
+};
+
+//
+// *This function returns the number of threads to use when the caller
+// does not say: one per hardware thread.
+//
+int defaultThreads() {
+    int n = (int) thread::hardware_concurrency();
+    return (n < 1) ? 1 : n;
+}
+
+// Shortest code length limit that still has room for all 257 symbols
+const int MIN_CODE_LENGTH_LIMIT = 9;
+
+//
+// *This function sets lengths to the best code lengths of at most
+// maxLength bits for a set of byte counts (plus PSEUDO_EOF with a count of
+// 1), using the package-merge algorithm.  Level 1 is the symbols sorted by
+// count; each next level is the symbols merged with the previous level's
+// items paired up into packages.  The 2n - 2 cheapest items of the last
+// level are taken, and each symbol's code length is the number of times
+// it is taken on any level (a package taken means both of its items are).
+//
+void limitCodeLengths(const long long counts[256], int maxLength,
+                      unsigned char lengths[NUM_SYMBOLS]) {
+    struct item {
+      long long weight;
+      int symbol;  // -1 for a package
+    };
+    vector<item> leaves;
+    for (int i = 0; i < 256; i++) {
+      if (counts[i] > 0) {
+        leaves.push_back({counts[i], i});
+      }
+    }
+    leaves.push_back({1, 256});
+    auto lighter = [](const item& a, const item& b) {
+      return a.weight < b.weight;
+    };
+    stable_sort(leaves.begin(), leaves.end(), lighter);
+
+    for (int i = 0; i < NUM_SYMBOLS; i++) {
+      lengths[i] = 0;
+    }
+    size_t n = leaves.size();
+    // PSEUDO_EOF alone (an empty input) needs no code at all
+    if (n < 2) {
+      return;
+    }
+    maxLength = max(maxLength, MIN_CODE_LENGTH_LIMIT);
+
+    vector<vector<item>> levels(maxLength);
+    levels[0] = leaves;
+    for (int k = 1; k < maxLength; k++) {
+      const vector<item>& prev = levels[k - 1];
+      vector<item> packages;
+      for (size_t i = 0; i + 1 < prev.size(); i += 2) {
+        packages.push_back({prev[i].weight + prev[i + 1].weight, -1});
+      }
+      // On equal weights the symbol comes first
+      merge(leaves.begin(), leaves.end(), packages.begin(), packages.end(),
+            back_inserter(levels[k]), lighter);
+    }
+
+    // Packages are made and merged in order, so the packages among the
+    // items taken on one level are made from the first items of the level
+    // below
+    size_t take = 2 * n - 2;
+    for (int k = maxLength - 1; k >= 0; k--) {
+      size_t packages = 0;
+      for (size_t i = 0; i < take; i++) {
+        if (levels[k][i].symbol >= 0) {
+          lengths[levels[k][i].symbol]++;
+        } else {
+          packages++;
+        }
+      }
+      take = 2 * packages;
+    }
+}
+
+//
+// *This function returns the number of bits the counts (plus PSEUDO_EOF)
+// take with the given code lengths, not counting the header.
+//
+long long codeLengthBits(const long long counts[256], const unsigned char lengths[NUM_SYMBOLS]) {
+    long long bits = lengths[256];
+    for (int i = 0; i < 256; i++) {
+      bits += counts[i] * lengths[i];
+    }
+    return bits;
+}
+
+//
+// *This function builds the code lengths for a set of byte counts (plus
+// PSEUDO_EOF) by way of a frequency map and an encoding tree.  The tree
+// adds counts up in an int, so inputs over 1 GB have their counts scaled
+// down first (every byte that occurs keeps a count of at least 1).
+//
+// If maxLength is more than 0 and the tree has a longer code than that,
+// the lengths are rebuilt with limitCodeLengths, so every code fits in
+// the decoder's table (DECODE_TABLE_BITS) or a register.  Limits below
+// MIN_CODE_LENGTH_LIMIT are raised to it.
+//
+void buildLengthsFromCounts(const long long counts[256], unsigned char lengths[NUM_SYMBOLS],
+                            int maxLength = 0) {
+    long long total = 0;
+    for (int i = 0; i < 256; i++) {
+      total += counts[i];
+    }
+    int shift = 0;
+    while ((total >> shift) > (1LL << 30)) {
+      shift++;
+    }
+    hashmap frequencyMap;
+    frequencyMap.reserve(NUM_SYMBOLS);
+    for (int i = 0; i < 256; i++) {
+      if (counts[i] > 0) {
+        frequencyMap.put(symbolCharacter(i), (int) max(1LL, counts[i] >> shift));
+      }
+    }
+    frequencyMap.put(PSEUDO_EOF, 1);
+    buildCodeLengths(buildEncodingTree(frequencyMap), lengths);
+    if (maxLength > 0 && *max_element(lengths, lengths + NUM_SYMBOLS) > maxLength) {
+      limitCodeLengths(counts, maxLength, lengths);
+    }
+}
+
+//
+// *This function compresses one block of data on its own and returns the
+// compressed bytes: a code-length table followed by the encoded bits
+// (ending with PSEUDO_EOF, padded to a whole byte).  maxCodeLength is
+// passed to buildLengthsFromCounts.
+//
+string compressBlock(const char* data, size_t n, int maxCodeLength = 0) {
+    long long counts[256] = {0};
+    countBytes(data, n, counts);
+    unsigned char lengths[NUM_SYMBOLS];
+    buildLengthsFromCounts(counts, lengths, maxCodeLength);
+    HuffmanCode table[NUM_SYMBOLS];
+    buildEncodingTable(buildCanonicalTree(lengths), table);
+
+    ostringstream output;
+    writeLengthTable(output, lengths);
+    bitWriter writer(&output);
+    encodeBytes(data, n, table, writer, nullptr);
+    writer.write(table[256].bits, table[256].length);
+    writer.finish();
+    return output.str();
+}
+
+//
+// *This function decompresses one block made by compressBlock into output
+// and returns the number of bytes written, or -1 if the block is not
+// valid or ends before PSEUDO_EOF.  If text is not null, the bytes are
+// also appended to it.
+//
+long long decompressBlock(const char* data, size_t n, ostream& output, string* text) {
+    memoryBuffer buffer(data, n);
+    istream input(&buffer);
+    unsigned char lengths[NUM_SYMBOLS];
+    if (!readLengthTable(input, lengths)) {
+      return -1;
+    }
+    bool complete;
+    long long written = decodeBits(input, buildCanonicalTree(lengths), output, text, &complete);
+    return complete ? written : -1;
+}
+
+//
+// *This function compresses inName into the block container outName.  The
+// input is read numThreads blocks at a time and those blocks are
+// compressed at the same time, one per thread, so memory use is about
+// 2 * numThreads * blockSize.  maxCodeLength limits the code lengths of
+// every block (0 for no limit).  Returns false if a file cannot be opened.
+//
+bool compressBlocks(string inName, string outName, int numThreads,
+                    int blockSize = DEFAULT_BLOCK_SIZE, HuffmanStats* stats = nullptr,
+                    int maxCodeLength = 0) {
+    ifstream input(inName, ios::binary);
+    ofstream output(outName, ios::binary);
+    if (!input.is_open() || !output.is_open() || blockSize < 1) {
+      return false;
+    }
+    numThreads = (numThreads < 1) ? 1 : numThreads;
+
+    output.write(HUFFMAN_MAGIC, 4);
+    output.put((char) HUFFMAN_BLOCK_VERSION);
+    writeU64(output, blockSize);
+    long long headerBytes = output.tellp();
+
+    vector<HuffmanBlockInfo> index;
+    vector<string> raw(numThreads);
+    vector<string> packed(numThreads);
+    long long inputBytes = 0;
+    bool more = true;
+    while (more) {
+      // Read the next round of blocks
+      int count = 0;
+      while (count < numThreads) {
+        raw[count].resize(blockSize);
+        input.read(&raw[count][0], blockSize);
+        raw[count].resize(input.gcount());
+        if (raw[count].empty()) {
+          more = false;
+          break;
+        }
+        count++;
+        if (!input) {
+          more = false;
+          break;
+        }
+      }
+
+      // Compress them in parallel
+      vector<thread> threads;
+      for (int i = 1; i < count; i++) {
+        threads.emplace_back([&raw, &packed, i, maxCodeLength]() {
+          packed[i] = compressBlock(raw[i].data(), raw[i].size(), maxCodeLength);
+        });
+      }
+      if (count > 0) {
+        packed[0] = compressBlock(raw[0].data(), raw[0].size(), maxCodeLength);
+      }
+      for (auto& t : threads) {
+        t.join();
+      }
+
+      // Write them in order
+      for (int i = 0; i < count; i++) {
+        HuffmanBlockInfo info;
+        info.offset = output.tellp();
+        info.compressedBytes = packed[i].size();
+        info.rawBytes = raw[i].size();
+        output.write(packed[i].data(), packed[i].size());
+        index.push_back(info);
+        inputBytes += raw[i].size();
+      }
+    }
+
+    // The index and the trailer that points back at it
+    long long indexOffset = output.tellp();
+    for (const HuffmanBlockInfo& info : index) {
+      writeU64(output, info.offset);
+      writeU64(output, info.compressedBytes);
+      writeU64(output, info.rawBytes);
+    }
+    writeU64(output, index.size());
+    writeU64(output, indexOffset);
+    output.write(HUFFMAN_INDEX_MAGIC, 4);
+
+    if (stats != nullptr) {
+      stats->inputBytes = inputBytes;
+      stats->headerBytes = headerBytes;
+      stats->outputBytes = output.tellp();
+    }
+    return !output.fail();
+}
+
+//
+// *This function reads the block index of a block container.  Returns
+// false if input is not a valid block container.
+//
+bool readBlockIndex(istream& input, vector<HuffmanBlockInfo>& index) {
+    char magic[4];
+    input.seekg(0);
+    if (!input.read(magic, 4) || memcmp(magic, HUFFMAN_MAGIC, 4) != 0 ||
+        input.get() != HUFFMAN_BLOCK_VERSION) {
+      return false;
+    }
+    input.seekg(0, ios::end);
+    long long fileSize = input.tellg();
+    if (fileSize < 13 + HUFFMAN_TRAILER_SIZE) {
+      return false;
+    }
+    input.seekg(fileSize - HUFFMAN_TRAILER_SIZE);
+    unsigned long long count = readU64(input);
+    unsigned long long indexOffset = readU64(input);
+    // bound count and indexOffset first so the sum below cannot wrap
+    unsigned long long maxCount = (fileSize - 13 - HUFFMAN_TRAILER_SIZE) / 24;
+    if (!input.read(magic, 4) || memcmp(magic, HUFFMAN_INDEX_MAGIC, 4) != 0 ||
+        count > maxCount || indexOffset > (unsigned long long) fileSize ||
+        indexOffset + count * 24 + HUFFMAN_TRAILER_SIZE != (unsigned long long) fileSize) {
+      return false;
+    }
+
+    input.seekg(indexOffset);
+    index.resize(count);
+    for (HuffmanBlockInfo& info : index) {
+      info.offset = readU64(input);
+      info.compressedBytes = readU64(input);
+      info.rawBytes = readU64(input);
+      // the u64 fields land in long long: negative means the top bit was
+      // set, and the block must end before the index
+      if (info.offset < 13 || info.compressedBytes < 0 || info.rawBytes < 0 ||
+          info.compressedBytes > (long long) indexOffset - info.offset) {
+        return false;
+      }
+    }
+    return !input.fail();
+}
+
+//
+// *This function decompresses the block container inName into outName,
+// decoding numThreads blocks at a time in parallel.  Appends the decoded
+// text to text if it is not null (for testing).  Returns false if a file
+// cannot be opened or the container is damaged.
+//
+bool decompressBlocks(string inName, string outName, int numThreads,
+                      HuffmanStats* stats = nullptr, string* text = nullptr) {
+    // The blocks are decoded straight out of the mapped file
+    mappedfile file(inName);
+    if (!file.is_open()) {
+      return false;
+    }
+    memoryBuffer buffer(file.data(), file.size());
+    istream input(&buffer);
+    vector<HuffmanBlockInfo> index;
+    if (!readBlockIndex(input, index)) {
+      return false;
+    }
+    ofstream output(outName, ios::binary);
+    if (!output.is_open()) {
+      return false;
+    }
+    numThreads = (numThreads < 1) ? 1 : numThreads;
+
+    vector<ostringstream> raw(numThreads);
+    vector<long long> written(numThreads);
+    long long outputBytes = 0;
+    for (size_t first = 0; first < index.size(); first += numThreads) {
+      int count = (int) min((size_t) numThreads, index.size() - first);
+      for (int i = 0; i < count; i++) {
+        raw[i].str("");
+      }
+
+      auto decodeOne = [&](int i) {
+        const HuffmanBlockInfo& info = index[first + i];
+        written[i] = decompressBlock(file.data() + info.offset, info.compressedBytes,
+                                     raw[i], nullptr);
+      };
+      vector<thread> threads;
+      for (int i = 1; i < count; i++) {
+        threads.emplace_back(decodeOne, i);
+      }
+      decodeOne(0);
+      for (auto& t : threads) {
+        t.join();
+      }
+
+      for (int i = 0; i < count; i++) {
+        if (written[i] != index[first + i].rawBytes) {
+          return false;
+        }
+        string block = raw[i].str();
+        output.write(block.data(), block.size());
+        if (text != nullptr) {
+          text->append(block);
+        }
+        outputBytes += block.size();
+      }
+    }
+
+    if (stats != nullptr) {
+      stats->inputBytes = file.size();
+      stats->headerBytes = 13;
+      stats->outputBytes = outputBytes;
+    }
+    return !output.fail();
+}
+
+//
+// *This function decompresses only block number block of the container
+// inName into text.  Returns false if there is no such block.
+//
+bool decompressBlockAt(string inName, int block, string& text) {
+    mappedfile file(inName);
+    if (!file.is_open()) {
+      return false;
+    }
+    memoryBuffer buffer(file.data(), file.size());
+    istream input(&buffer);
+    vector<HuffmanBlockInfo> index;
+    if (!readBlockIndex(input, index) || block < 0 || block >= (int) index.size()) {
+      return false;
+    }
+    ostringstream raw;
+    text = "";
+    return decompressBlock(file.data() + index[block].offset, index[block].compressedBytes,
+                           raw, &text) == index[block].rawBytes;
+}
+
+//
+// *This function returns the version byte of a compressed file (0 for the
+// original frequency map header, -1 if it is not a compressed file) and
+// leaves input at the start of the file.
+//
+int huffmanVersion(istream& input) {
+    char header[5];
+    int version = -1;
+    if (input.read(header, 5)) {
+      if (header[0] == '{') {
+        version = 0;
+      } else if (memcmp(header, HUFFMAN_MAGIC, 4) == 0) {
+        version = header[4];
+      }
+    } else if (input.gcount() > 0 && header[0] == '{') {
+      version = 0;
+    }
+    input.clear();
+    input.seekg(0);
+    return version;
+}
+
+// Version byte of the stream format, which needs no seeking and no second
+// pass: the input is cut into frames of at most blockSize bytes, and the
+// code table is rebuilt every rebuildBytes bytes from the counts of the
+// data already sent.  The decoder sees the same data and rebuilds the same
+// table, so tables are never stored in the stream.
+const int HUFFMAN_STREAM_VERSION = 3;
+// Default largest frame, which bounds memory use on both ends
+const int STREAM_BLOCK_SIZE = 1 << 14;
+// Default # of bytes between table rebuilds
+const int STREAM_REBUILD_BYTES = 1 << 18;
+// The first rebuild comes after this many bytes, and the gap doubles until
+// it reaches rebuildBytes, so short streams get a fitted table early
+const int STREAM_FIRST_REBUILD = 1 << 12;
+
+//
+// *This function builds the stream's next code lengths from history, the
+// byte counts seen so far.  Every byte gets one extra count so it always
+// has a code, and history is halved afterwards so that older data counts
+// for less as the stream goes on.  The encoder and the decoder both call
+// this at the same points in the stream.
+//
+void rebuildStreamLengths(long long history[256], unsigned char lengths[NUM_SYMBOLS]) {
+    long long counts[256];
+    for (int b = 0; b < 256; b++) {
+      counts[b] = history[b] + 1;
+      history[b] /= 2;
+    }
+    buildLengthsFromCounts(counts, lengths);
+}
+
+//
+// *This function returns how many bytes the stream waits, after rebuild
+// number rebuilds, before rebuilding the table again.
+//
+long long streamRebuildGap(int rebuilds, long long rebuildBytes) {
+    long long gap = STREAM_FIRST_REBUILD;
+    for (int i = 0; i < rebuilds && gap < rebuildBytes; i++) {
+      gap *= 2;
+    }
+    return min(gap, rebuildBytes);
+}
+
+//
+// *This function compresses everything read from the file descriptor inFd
+// (a pipe, a terminal or a file) into output using the stream format.  A
+// frame is written, and output flushed, as soon as blockSize bytes are
+// waiting or a read comes back short because no more input is ready yet,
+// so a slow producer's data is not held back.  Memory use does not depend
+// on the length of the input.  Returns false on a read error.
+//
+bool compressStream(int inFd, ostream& output, int blockSize = STREAM_BLOCK_SIZE,
+                    int rebuildBytes = STREAM_REBUILD_BYTES, HuffmanStats* stats = nullptr) {
+    if (blockSize < 1 || rebuildBytes < 1) {
+      return false;
+    }
+    output.write(HUFFMAN_MAGIC, 4);
+    output.put((char) HUFFMAN_STREAM_VERSION);
+    writeU64(output, blockSize);
+    writeU64(output, rebuildBytes);
+    long long headerBytes = 21;
+    long long outputBytes = headerBytes;
+
+    long long history[256] = {0};
+    unsigned char lengths[NUM_SYMBOLS];
+    HuffmanCode table[NUM_SYMBOLS];
+    auto rebuild = [&]() {
+      rebuildStreamLengths(history, lengths);
+      buildEncodingTable(buildCanonicalTree(lengths), table);
+    };
+    rebuild();
+
+    vector<char> block(blockSize);
+    size_t used = 0;
+    long long sinceRebuild = 0;
+    int rebuilds = 0;
+    long long inputBytes = 0;
+    ostringstream frame;
+    bool done = false;
+    while (!done) {
+      ssize_t n = ::read(inFd, block.data() + used, blockSize - used);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      used += n;
+      done = (n == 0);
+      // A read either fills the block or stops short because the input
+      // ended or has nothing more ready, so the waiting bytes go out now
+      if (used == 0) {
+        continue;
+      }
+
+      // Encode the frame, ending it with PSEUDO_EOF
+      frame.str("");
+      bitWriter writer(&frame);
+      encodeBytes(block.data(), used, table, writer, nullptr);
+      writer.write(table[256].bits, table[256].length);
+      writer.finish();
+      string bits = frame.str();
+      writeVarint(output, bits.size());
+      output.write(bits.data(), bits.size());
+      output.flush();
+      outputBytes += varintSize(bits.size()) + bits.size();
+
+      countBytes(block.data(), used, history);
+      inputBytes += used;
+      sinceRebuild += used;
+      used = 0;
+      if (sinceRebuild >= streamRebuildGap(rebuilds, rebuildBytes)) {
+        rebuild();
+        rebuilds++;
+        sinceRebuild = 0;
+      }
+    }
+    // A zero-length frame ends the stream
+    writeVarint(output, 0);
+    output.flush();
+    outputBytes++;
+
+    if (stats != nullptr) {
+      stats->inputBytes = inputBytes;
+      stats->headerBytes = headerBytes;
+      stats->outputBytes = outputBytes;
+    }
+    return !output.fail();
+}
+
+//
+// *This function decompresses a stream made by compressStream from input
+// into output, one frame at a time, flushing output after each frame.  If
+// text is not null, the bytes are also appended to it.  Returns false if
+// the stream is not valid or ends early.
+//
+bool decompressStream(istream& input, ostream& output,
+                      HuffmanStats* stats = nullptr, string* text = nullptr) {
+    char magic[4];
+    if (!input.read(magic, 4) || memcmp(magic, HUFFMAN_MAGIC, 4) != 0 ||
+        input.get() != HUFFMAN_STREAM_VERSION) {
+      return false;
+    }
+    unsigned long long blockSize = readU64(input);
+    unsigned long long rebuildBytes = readU64(input);
+    if (!input || blockSize < 1 || blockSize > (1u << 30) ||
+        rebuildBytes < 1 || rebuildBytes > (1ULL << 62)) {
+      return false;
+    }
+    long long inputBytes = 21;
+    long long outputBytes = 0;
+
+    long long history[256] = {0};
+    unsigned char lengths[NUM_SYMBOLS];
+    rebuildStreamLengths(history, lengths);
+    HuffmanTree tree = buildCanonicalTree(lengths);
+
+    string packed;
+    string raw;
+    ostringstream sink;
+    long long sinceRebuild = 0;
+    int rebuilds = 0;
+    bool ok = false;
+    unsigned long long frameBytes;
+    while (readVarint(input, frameBytes)) {
+      inputBytes += varintSize(frameBytes);
+      if (frameBytes == 0) {
+        ok = true;
+        break;
+      }
+      // No code is longer than 64 bits, which bounds a valid frame
+      if (frameBytes > blockSize * 8 + 8) {
+        break;
+      }
+      packed.resize(frameBytes);
+      if (!input.read(&packed[0], frameBytes)) {
+        break;
+      }
+      inputBytes += frameBytes;
+
+      memoryBuffer buffer(packed.data(), packed.size());
+      istream frame(&buffer);
+      raw.clear();
+      bool complete;
+      decodeBits(frame, tree, sink, &raw, &complete);
+      sink.str("");
+      if (!complete || raw.empty() || raw.size() > blockSize) {
+        break;
+      }
+      output.write(raw.data(), raw.size());
+      output.flush();
+      if (text != nullptr) {
+        text->append(raw);
+      }
+      outputBytes += raw.size();
+
+      countBytes(raw.data(), raw.size(), history);
+      sinceRebuild += raw.size();
+      if (sinceRebuild >= streamRebuildGap(rebuilds, rebuildBytes)) {
+        rebuildStreamLengths(history, lengths);
+        tree = buildCanonicalTree(lengths);
+        rebuilds++;
+        sinceRebuild = 0;
+      }
+    }
+
+    if (stats != nullptr) {
+      stats->inputBytes = inputBytes;
+      stats->headerBytes = 21;
+      stats->outputBytes = outputBytes;
+    }
+    return ok && !output.fail();
+}
+
+// Version byte of the rANS container, which is also its codec id: the
+// same frequency counts as Huffman, coded with rANS (see rans.h) instead
+// of Huffman codes.  After the version come the input size (varint) and
+// the frequency table, then the input coded in chunks of RANS_CHUNK_SIZE
+// bytes, each as its encoded size (varint) and the encoded bytes.
+const int RANS_VERSION = 4;
+// # of input bytes per chunk, which bounds the encoder's buffer
+const int RANS_CHUNK_SIZE = 1 << 20;
+
+//
+// *This function writes a rANS frequency table: a 32-byte bitmap of the
+// bytes that occur, then the frequency of each of them as a varint.
+//
+void writeFrequencyTable(ostream& output, const uint32_t freqs[256]) {
+    unsigned char present[32] = {0};
+    for (int i = 0; i < 256; i++) {
+      if (freqs[i] != 0) {
+        present[i / 8] |= 1 << (i % 8);
+      }
+    }
+    output.write((const char*) present, 32);
+    for (int i = 0; i < 256; i++) {
+      if (freqs[i] != 0) {
+        writeVarint(output, freqs[i]);
+      }
+    }
+}
+
+//
+// *This function reads a frequency table written by writeFrequencyTable.
+// The frequencies must add up to exactly RANS_TOTAL, or be all 0 when
+// empty is true (the table of an empty input).  Returns false otherwise.
+//
+bool readFrequencyTable(istream& input, uint32_t freqs[256], bool empty) {
+    unsigned char present[32];
+    if (!input.read((char*) present, 32)) {
+      return false;
+    }
+    unsigned long long sum = 0;
+    for (int i = 0; i < 256; i++) {
+      unsigned long long freq = 0;
+      if (((present[i / 8] >> (i % 8)) & 1) &&
+          (!readVarint(input, freq) || freq == 0 || freq > RANS_TOTAL - sum)) {
+        return false;
+      }
+      freqs[i] = (uint32_t) freq;
+      sum += freq;
+    }
+    return sum == (empty ? 0 : RANS_TOTAL);
+}
+
+//
+// *This function writes the n bytes of data to output as a rANS container.
+// Fills in stats if it is not null.
+//
+void compressRans(const char* data, size_t n, ostream& output, HuffmanStats* stats) {
+    long long counts[256] = {0};
+    countBytes(data, n, counts);
+    uint32_t freqs[256];
+    normalizeFrequencies(counts, freqs);
+
+    output.write(HUFFMAN_MAGIC, 4);
+    output.put((char) RANS_VERSION);
+    writeVarint(output, n);
+    writeFrequencyTable(output, freqs);
+    long long headerBytes = 5 + varintSize(n) + 32;
+    for (int i = 0; i < 256; i++) {
+      headerBytes += (freqs[i] != 0) ? varintSize(freqs[i]) : 0;
+    }
+
+    long long outputBytes = headerBytes;
+    for (size_t offset = 0; offset < n; offset += RANS_CHUNK_SIZE) {
+      string chunk = ransEncode(data + offset, min((size_t) RANS_CHUNK_SIZE, n - offset), freqs);
+      writeVarint(output, chunk.size());
+      output.write(chunk.data(), chunk.size());
+      outputBytes += varintSize(chunk.size()) + chunk.size();
+    }
+
+    if (stats != nullptr) {
+      stats->inputBytes = n;
+      stats->headerBytes = headerBytes;
+      stats->outputBytes = outputBytes;
+    }
+}
+
+//
+// *This function decodes the rANS container in the size bytes at data into
+// output.  If text is not null, the bytes are also appended to it.
+// Returns false if the container is not valid.
+//
+bool decompressRans(const char* data, size_t size, ostream& output,
+                    HuffmanStats* stats = nullptr, string* text = nullptr) {
+    memoryBuffer buffer(data, size);
+    istream input(&buffer);
+    char magic[4];
+    unsigned long long n;
+    uint32_t freqs[256];
+    if (!input.read(magic, 4) || memcmp(magic, HUFFMAN_MAGIC, 4) != 0 ||
+        input.get() != RANS_VERSION || !readVarint(input, n) ||
+        !readFrequencyTable(input, freqs, n == 0)) {
+      return false;
+    }
+    long long headerBytes = input.tellg();
+
+    vector<char> raw(min(n, (unsigned long long) RANS_CHUNK_SIZE));
+    for (unsigned long long offset = 0; offset < n; offset += RANS_CHUNK_SIZE) {
+      unsigned long long encoded;
+      if (!readVarint(input, encoded) ||
+          encoded > size - (unsigned long long) input.tellg()) {
+        return false;
+      }
+      size_t chunk = (size_t) min(n - offset, (unsigned long long) RANS_CHUNK_SIZE);
+      const char* start = data + (size_t) input.tellg();
+      if (!ransDecode(start, encoded, freqs, raw.data(), chunk)) {
+        return false;
+      }
+      input.seekg(encoded, ios::cur);
+      output.write(raw.data(), chunk);
+      if (text != nullptr) {
+        text->append(raw.data(), chunk);
+      }
+    }
+
+    if (stats != nullptr) {
+      stats->inputBytes = size;
+      stats->headerBytes = headerBytes;
+      stats->outputBytes = n;
+    }
+    return input.tellg() == (streampos) size && !output.fail();
+}
+
+// Version byte of the LZ77 container: the input is parsed into literals
+// and matches (see lz77.h), and each of the parse's streams is Huffman
+// coded as a block (see compressBlock).  After the version comes the
+// window (varint), then the blocks, each as its raw size (varint) and its
+// five streams, each as its size (varint, 0 for an empty stream) and
+// bytes.  A raw size of 0 ends the file.
+const int LZ77_VERSION = 5;
+// # of input bytes per block; matches do not cross blocks
+const int LZ77_BLOCK_SIZE = 1 << 23;
+
+//
+// *This function returns the streams of parse in the order the LZ77
+// container stores them.
+//
+vector<string*> lzStreamList(lzStreams& parse) {
+    return {&parse.tokens, &parse.literals, &parse.lengths, &parse.distLow, &parse.distHigh};
+}
+
+//
+// *This function writes the n bytes of data to output as an LZ77
+// container.  window is rounded up to a power of two and capped at
+// LZ_MAX_WINDOW; maxChain is passed to lzParse.  Fills in stats if it is
+// not null.
+//
+void compressLz77(const char* data, size_t n, ostream& output, HuffmanStats* stats,
+                  int window = LZ_DEFAULT_WINDOW, int maxChain = LZ_DEFAULT_CHAIN) {
+    int roundedWindow = 1;
+    while (roundedWindow < window && roundedWindow < LZ_MAX_WINDOW) {
+      roundedWindow *= 2;
+    }
+    output.write(HUFFMAN_MAGIC, 4);
+    output.put((char) LZ77_VERSION);
+    writeVarint(output, roundedWindow);
+    long long headerBytes = 5 + varintSize(roundedWindow);
+
+    long long outputBytes = headerBytes;
+    lzStreams parse;
+    vector<string> packed(5);
+    for (size_t offset = 0; offset < n; offset += LZ77_BLOCK_SIZE) {
+      size_t blockBytes = min((size_t) LZ77_BLOCK_SIZE, n - offset);
+      auto pack = [&]() {
+        size_t total = 0;
+        vector<string*> streams = lzStreamList(parse);
+        for (size_t i = 0; i < streams.size(); i++) {
+          packed[i] = streams[i]->empty() ? string() : compressBlock(streams[i]->data(), streams[i]->size());
+          total += packed[i].size();
+        }
+        return total;
+      };
+      lzParse(data + offset, blockBytes, roundedWindow, maxChain, parse);
+      size_t total = pack();
+
+      // Data with little repetition codes smaller as plain Huffman: then
+      // the block is sent as one sequence of literals
+      long long counts[256] = {0};
+      countBytes(data + offset, blockBytes, counts);
+      unsigned char lengths[NUM_SYMBOLS];
+      buildLengthsFromCounts(counts, lengths);
+      long long literalBytes = (codeLengthBits(counts, lengths) + 7) / 8 + 64;
+      if ((long long) total > literalBytes) {
+        parse = lzStreams();
+        lzEmit(parse, data + offset, blockBytes, 0, 0);
+        pack();
+      }
+
+      writeVarint(output, blockBytes);
+      outputBytes += varintSize(blockBytes);
+      for (const string& stream : packed) {
+        writeVarint(output, stream.size());
+        output.write(stream.data(), stream.size());
+        outputBytes += varintSize(stream.size()) + stream.size();
+      }
+    }
+    writeVarint(output, 0);
+    outputBytes++;
+
+    if (stats != nullptr) {
+      stats->inputBytes = n;
+      stats->headerBytes = headerBytes;
+      stats->outputBytes = outputBytes;
+    }
+}
+
+//
+// *This function decodes the LZ77 container in the size bytes at data into
+// output.  If text is not null, the bytes are also appended to it.
+// Returns false if the container is not valid.
+//
+bool decompressLz77(const char* data, size_t size, ostream& output,
+                    HuffmanStats* stats = nullptr, string* text = nullptr) {
+    const char* p = data;
+    const char* end = data + size;
+    unsigned long long window;
+    if (size < 5 || memcmp(p, HUFFMAN_MAGIC, 4) != 0 || p[4] != LZ77_VERSION) {
+      return false;
+    }
+    p += 5;
+    if (!readVarint(p, end, window) || window > (unsigned long long) LZ_MAX_WINDOW) {
+      return false;
+    }
+    long long headerBytes = p - data;
+
+    long long outputBytes = 0;
+    lzStreams parse;
+    vector<char> raw;
+    while (true) {
+      unsigned long long blockBytes;
+      if (!readVarint(p, end, blockBytes) || blockBytes > (unsigned long long) LZ77_BLOCK_SIZE) {
+        return false;
+      }
+      if (blockBytes == 0) {
+        break;
+      }
+      for (string* stream : lzStreamList(parse)) {
+        unsigned long long packed;
+        if (!readVarint(p, end, packed) || packed > (unsigned long long) (end - p)) {
+          return false;
+        }
+        stream->clear();
+        if (packed > 0) {
+          ostringstream unpacked;
+          if (decompressBlock(p, packed, unpacked, nullptr) < 0) {
+            return false;
+          }
+          *stream = unpacked.str();
+        }
+        p += packed;
+      }
+      raw.resize(blockBytes);
+      if (!lzRebuild(parse, raw.data(), blockBytes)) {
+        return false;
+      }
+      output.write(raw.data(), blockBytes);
+      if (text != nullptr) {
+        text->append(raw.data(), blockBytes);
+      }
+      outputBytes += blockBytes;
+    }
+
+    if (stats != nullptr) {
+      stats->inputBytes = size;
+      stats->headerBytes = headerBytes;
+      stats->outputBytes = outputBytes;
+    }
+    return p == end && !output.fail();
+}
+
+//
+// *This function compresses the file inName into outName.  The input is
+// memory mapped (see mappedfile), so the count pass and the encode pass
+// scan the same pages, and the output is written as it is produced.
+// Fills in stats if it is not null, and appends the bit pattern to
+// bitString if that is not null (for testing).  maxCodeLength limits the
+// code lengths (0 for no limit).  codec picks the format: HUFFMAN_VERSION,
+// RANS_VERSION for the rANS container, or LZ77_VERSION for the LZ77
+// container with the given window (both leave bitString alone).
+// Returns false if a file cannot be opened.
+//
+bool compressFile(string inName, string outName, HuffmanStats* stats = nullptr,
+                  string* bitString = nullptr, int maxCodeLength = 0,
+                  int codec = HUFFMAN_VERSION, int window = LZ_DEFAULT_WINDOW) {
+    mappedfile input(inName);
+    if (!input.is_open()) {
+      return false;
+    }
+    ofbitstream output(outName);
+    if (!output.is_open()) {
+      return false;
+    }
+    if (codec == RANS_VERSION) {
+      compressRans(input.data(), input.size(), output, stats);
+      return !output.fail();
+    }
+    if (codec == LZ77_VERSION) {
+      compressLz77(input.data(), input.size(), output, stats, window);
+      return !output.fail();
+    }
+    // count the bytes, and build the code lengths from the counts
+    long long counts[256] = {0};
+    countBytes(input.data(), input.size(), counts);
+    unsigned char lengths[NUM_SYMBOLS];
+    buildLengthsFromCounts(counts, lengths, maxCodeLength);
+    // build the flat encoding table from the canonical codes of those lengths
+    HuffmanCode table[NUM_SYMBOLS];
+    buildEncodingTable(buildCanonicalTree(lengths), table);
+    // Use the code lengths to add the header of the output file
+    writeCodeLengths(output, lengths);
+    long long headerBytes = output.tellp();
+
+    // encode the file, then PSEUDO_EOF
+    bitWriter writer(&output);
+    encodeBytes(input.data(), input.size(), table, writer, bitString);
+    writer.write(table[256].bits, table[256].length);
+    if (bitString != nullptr) {
+      appendBitString(table[256], bitString);
+    }
+    writer.finish();
+
+    if (stats != nullptr) {
+      stats->inputBytes = input.size();
+      stats->headerBytes = headerBytes;
+      stats->outputBytes = headerBytes + (writer.bitsWritten() + 7) / 8;
+    }
+    return true;
+}
+
+//
+// *This function decompresses the file inName into outName.  The input is
+// memory mapped and read through a memoryBuffer, and the output is
+// written through fixed-size buffers.  Fills in stats if it is not null,
+// and appends the decoded text to text if that is not null (for testing).
+// Block containers are decoded numThreads blocks at a time (0 means
+// defaultThreads()).  Returns false if a file cannot be opened, the
+// header is not valid, or the input is cut short: it ends before
+// PSEUDO_EOF, or decodes to fewer bytes than the header says.
+//
+bool decompressFile(string inName, string outName,
+                    HuffmanStats* stats = nullptr, string* text = nullptr,
+                    int numThreads = 0) {
+    mappedfile file(inName);
+    if (!file.is_open()) {
+      return false;
+    }
+    memoryBuffer buffer(file.data(), file.size());
+    istream input(&buffer);
+    // Block containers carry an index and are decoded block by block
+    int version = huffmanVersion(input);
+    if (version == HUFFMAN_BLOCK_VERSION) {
+      numThreads = (numThreads > 0) ? numThreads : defaultThreads();
+      return decompressBlocks(inName, outName, numThreads, stats, text);
+    }
+    // Streams are decoded frame by frame
+    if (version == HUFFMAN_STREAM_VERSION) {
+      ofstream output(outName, ios::binary);
+      return output.is_open() && decompressStream(input, output, stats, text);
+    }
+    // rANS containers are decoded chunk by chunk out of the mapped file
+    if (version == RANS_VERSION) {
+      ofstream output(outName, ios::binary);
+      return output.is_open() && decompressRans(file.data(), file.size(), output, stats, text);
+    }
+    if (version == LZ77_VERSION) {
+      ofstream output(outName, ios::binary);
+      return output.is_open() && decompressLz77(file.data(), file.size(), output, stats, text);
+    }
+    // Extract the header and build the encoding tree from it
+    long long expectedBytes;
+    HuffmanTree tree = readEncodingTree(input, &expectedBytes);
+    if (tree.empty()) {
+      return false;
+    }
+    long long headerBytes = input.tellg();
+    ofstream output(outName, ios::binary);
+    if (!output.is_open()) {
+      return false;
+    }
+    // Decode the input
+    bool complete;
+    long long written = decodeBits(input, tree, output, text, &complete);
+
+    if (stats != nullptr) {
+      stats->inputBytes = file.size();
+      stats->headerBytes = headerBytes;
+      stats->outputBytes = written;
+    }
+    return complete && (expectedBytes < 0 || written == expectedBytes);
+}
+
+//
+// *This function completes the entire compression process.  Given a file,
+// filename, this function (1) builds a frequency map; (2) builds an encoding
+// tree; (3) builds an encoding map; (4) encodes the file (don't forget to
+// include the frequency map in the header of the output file).  This function
+// should create a compressed file named (filename + ".huf") and should also
+// return a string version of the bit pattern.
+//
+// This is a test wrapper around compressFile; the bit pattern string is
+// as large as eight times the compressed file.
+//
+string compress(string filename) {
+    string result = "";
+    compressFile(filename, filename + ".huf", nullptr, &result);
+    return result;
+}
+
+//
 // *This function completes the entire decompression process.  Given the file,
 // filename (which should end with ".huf"), (1) extract the header and build
 // the frequency map; (2) build an encoding tree from the frequency map; (3)
@@ -268,21 +2102,18 @@ string compress(string filename) {
 // uncompressed file.  Note: this function should reverse what the compress
 // function did.
 //
+// This is a test wrapper around decompressFile that keeps the whole
+// decoded file in memory.
+//
 string decompress(string filename) {
-    ifbitstream input(filename);
-    hashmap frequencyMap;
-    // Extract the header to build frequencyMap
-    input >> frequencyMap;
-    // build the encoding tree using the map
-    HuffmanNode* root = buildEncodingTree(frequencyMap);
-    // Create output file
-    int delimiterPos = filename.find('.');
+    // Create output file name from the name before the first '.' of the
+    // file name itself, so dots in directories ("./", "v1.2/") are skipped
+    size_t nameStart = filename.rfind('/');
+    nameStart = (nameStart == string::npos) ? 0 : nameStart + 1;
+    size_t delimiterPos = filename.find('.', nameStart);
     string newFilename = filename.substr(0, delimiterPos);
     newFilename += "_unc.txt";
-    ofstream output(newFilename);
-    // Decode the input
-    string result = decode(input, root, output);
-    // Free the allocated memory
-    freeTree(root);
+    string result = "";
+    decompressFile(filename, newFilename, nullptr, &result);
     return result;
 }
@@ -0,0 +1,94 @@
+// Shayan Rasheed
+// CS 251 - Project 6
+// File Compression App
+// Variable-length integers: 7 bits per byte, low bits first, with the top
+// bit set on every byte but the last.  Small numbers take one byte.
+// Signed numbers are zig-zagged first (0, -1, 1, -2, ... -> 0, 1, 2, 3, ...)
+// so small negative numbers stay small too.
+
+#pragma once
+#include <istream>
+#include <ostream>
+#include <streambuf>
+#include <string>
+
+using namespace std;
+
+inline void writeVarint(ostream& output, unsigned long long value) {
+    while (value >= 0x80) {
+      output.put((char) (value | 0x80));
+      value >>= 7;
+    }
+    output.put((char) value);
+}
+
+inline void writeVarint(string& output, unsigned long long value) {
+    while (value >= 0x80) {
+      output.push_back((char) (value | 0x80));
+      value >>= 7;
+    }
+    output.push_back((char) value);
+}
+
+// Reads from memory at p, which is moved past the varint; never reads at
+// or past end
+inline bool readVarint(const char*& p, const char* end, unsigned long long& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+      unsigned char c = (unsigned char) *p++;
+      value |= (unsigned long long) (c & 0x7f) << shift;
+      if ((c & 0x80) == 0) {
+        return true;
+      }
+    }
+    return false;
+}
+
+// Reads straight from a stream buffer, without a sentry per byte
+inline bool readVarint(streambuf* input, unsigned long long& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      int c = input->sbumpc();
+      if (c == EOF) {
+        return false;
+      }
+      value |= (unsigned long long) (c & 0x7f) << shift;
+      if ((c & 0x80) == 0) {
+        return true;
+      }
+    }
+    return false;
+}
+
+inline bool readVarint(istream& input, unsigned long long& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      int c = input.get();
+      if (c == EOF) {
+        return false;
+      }
+      value |= (unsigned long long) (c & 0x7f) << shift;
+      if ((c & 0x80) == 0) {
+        return true;
+      }
+    }
+    return false;
+}
+
+// # of bytes writeVarint uses for value
+inline int varintSize(unsigned long long value) {
+    int n = 1;
+    while (value >= 0x80) {
+      value >>= 7;
+      n++;
+    }
+    return n;
+}
+
+inline unsigned long long zigzag(long long value) {
+    return ((unsigned long long) value << 1) ^ (unsigned long long) (value >> 63);
+}
+
+inline long long unzigzag(unsigned long long value) {
+    return (long long) (value >> 1) ^ -(long long) (value & 1);
+}
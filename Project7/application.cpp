@@ -16,6 +16,45 @@
 //   https://wiki.openstreetmap.org/wiki/Relation
 //
 
+// BATCH MODE:
+//   application.exe --batch map.osm queries.txt results.txt [threads]
+// Routes every query in queries.txt without prompting.  Each line holds
+// two buildings separated by '|' (partial name or abbreviation); blank
+// lines and lines starting with # are skipped.  Use - for the queries
+// or results file to read stdin / write stdout.  Each result line is
+//   line#<TAB>status<TAB>miles<TAB>#nodes<TAB>encoded polyline
+// where status is OK, NOT_FOUND or UNREACHABLE.
+//
+
+// SERVER MODE:
+//   application.exe --serve map.osm [port] [threads]
+// Keeps the map loaded and answers JSON requests on 127.0.0.1:port
+// (default 8080):
+//   GET /route?from=SEO&to=LCA   walking route between two buildings
+//                                (404 if either is unknown or unreachable)
+//   GET /nearest?lat=41.87&lon=-87.65   building closest to a point
+//   GET /metrics                 request counts and latencies per path
+//   GET /stats                   routing counters and timings (see STATS)
+// A client that has not sent its request within 5 seconds is dropped.
+// servertest.cpp is a client that checks a running server.
+//
+
+// GRAPH CHECK:
+//   application.exe --check-graphs map.osm [sources]
+// Builds the footway graph as graph<long long, double> and as
+// compactgraph<long long, float> and compactgraph<long long, mmweight>,
+// runs dijkstra on each from the nearest node of every building (or of
+// the first sources buildings) and checks that every distance agrees
+// with the double graph's within the tolerance stated in compactgraph.h.
+// Prints the largest difference seen for each type; exits 1 on failure.
+//
+
+// STATS:
+//   add --stats to any mode to print routing counters and timings as
+//   JSON to cerr when the run ends, or --stats=query to also print them
+//   after every query.  Server mode always keeps them; see GET /stats.
+//
+
 // CREATIVE COMPONENT:
 // Takes in a list of locations and checks
 // to see if a destination is reachable
@@ -34,19 +73,38 @@
 #include <map>
 #include <cstdlib>
 #include <cstring>
+#include <cmath>
 #include <cassert>
 #include <algorithm>
 #include <queue>
-#include <stack>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <mutex>
 
 #include "tinyxml2.h"
 #include "dist.h"
 #include "osm.h"
 #include "graph.h"
+#include "compactgraph.h"
+#include "pathresult.h"
+#include "httpserver.h"
+#include "stats.h"
 
 using namespace std;
 using namespace tinyxml2;
 
+// Storage used for the footway graph.  For very large maps switch to
+// compactgraph<long long, float> or compactgraph<long long, mmweight>
+// (32-bit vertex indices, 8 bytes per edge); see compactgraph.h for the
+// distance tolerance of each weight type.
+typedef graph<long long, double> FootGraph;
+
+// Run-wide routing stats; turned on by --stats (totals at the end of the
+// run) or --stats=query (also one line per query), both written to cerr
+statsCollector runStats;
+
 const double INF = numeric_limits<double>::max();
 const long long MAX = numeric_limits<long long>::max();
 
@@ -96,12 +154,22 @@ BuildingInfo nearestBuilding(Coordinates midpoint,
 // returns the value of the node that
 // is closest to the cooridnates of the given building
 long long nearestNode(BuildingInfo b, map<long long,
-         Coordinates>& Nodes, vector<FootwayInfo>& Footways) {
+         Coordinates>& Nodes, vector<FootwayInfo>& Footways,
+         RouteStats* stats = nullptr) {
+  statsTimer timer(stats ? &stats->SnapMs : nullptr);
+  if (stats) {
+    stats->Snaps++;
+  }
   double min = INF;
   long long nearest;
   for (auto f : Footways) {
     for (unsigned int i = 0; i < f.Nodes.size(); i++) {
-      Coordinates c = Nodes[f.Nodes[i]];
+      // find, not [], so threads sharing Nodes only ever read it
+      auto it = Nodes.find(f.Nodes[i]);
+      if (it == Nodes.end()) {
+        continue;
+      }
+      const Coordinates& c = it->second;
       double dist = distBetween2Points(b.Coords.Lat, b.Coords.Lon, c.Lat, c.Lon);
       if (dist < min) {
         min = dist;
@@ -114,10 +182,15 @@ long long nearestNode(BuildingInfo b, map<long long,
 
 // Function dijkstra:
 // Performs the dijkstra algorithm to return a vector of visited nodes
-// as well as a map of distances from a starting vertex
-vector<long long> dijkstra(long long startV, graph<long long, double>& G,
+// as well as a map of distances from a starting vertex.  Works on any
+// graph with the graph.h interface (FootGraph, or a compactgraph).
+template <typename GraphT>
+vector<long long> dijkstra(long long startV, GraphT& G,
       map<long long, double>& distances, map<long long,
-      long long>& predecessors) {
+      long long>& predecessors, RouteStats* stats = nullptr) {
+  statsTimer timer(stats ? &stats->SearchMs : nullptr);
+  // Counted locally and copied into stats once at the end
+  long long pushes = 0, stalePops = 0, relaxed = 0;
   priority_queue<
     pair<long long, double>,
     vector<pair<long long, double>>,
@@ -136,10 +209,12 @@ vector<long long> dijkstra(long long startV, graph<long long, double>& G,
     // push the vertex into the queue with a value of INF
     unvisitedQueue.push(make_pair(v, INF));
   }
+  pushes += graphVerts.size();
 
   // Set the distance to the starting vertex to 0
   distances[startV] = 0;
   unvisitedQueue.push(make_pair(startV, 0));
+  pushes++;
 
   while (!unvisitedQueue.empty()) {
     // get the top of the queue
@@ -151,6 +226,7 @@ vector<long long> dijkstra(long long startV, graph<long long, double>& G,
       // If the vertex has already been visited, continue the loop
     } else if (visitedSet.count(currV) != 0) {
       unvisitedQueue.pop();
+      stalePops++;
       continue;
     }
 
@@ -163,7 +239,7 @@ vector<long long> dijkstra(long long startV, graph<long long, double>& G,
     // Loop through the neighbors of currV
     set<long long> neighbors = G.neighbors(currV);
     for (auto n : neighbors) {
-      double edgeWeight;
+      typename GraphT::weight_type edgeWeight;
       G.getWeight(currV, n, edgeWeight);
       // Update the distance in the map for currV
       double altDistance = distances[currV] + edgeWeight;
@@ -174,9 +250,19 @@ vector<long long> dijkstra(long long startV, graph<long long, double>& G,
         predecessors[n] = currV;
         // push the neighbor into the queue with its new distance
         unvisitedQueue.push(make_pair(n, altDistance));
+        pushes++;
+        relaxed++;
       }
     }
   }
+
+  if (stats) {
+    stats->Searches++;
+    stats->Settled += visited.size();
+    stats->Pushes += pushes;
+    stats->StalePops += stalePops;
+    stats->Relaxed += relaxed;
+  }
   return visited;
 }
 
@@ -184,21 +270,42 @@ vector<long long> dijkstra(long long startV, graph<long long, double>& G,
 // returns a vector that represents a path
 // to an end vertex based on a predecessors map
 vector<long long> getPath(map<long long, long long>& predecessors,
-       long long endV) {
+       long long endV, RouteStats* stats = nullptr) {
+  statsTimer timer(stats ? &stats->UnpackMs : nullptr);
   vector<long long> result;
-  // The ending vertex will be pushed onto the stack first
+  // Walk back from the ending vertex, then reverse into start->end order
   long long currV = endV;
-  stack<long long> vStack;
   while (currV != 0) {
-    vStack.push(currV);
+    result.push_back(currV);
     // set currV to the corresponding value in the predecessors map
-    currV = predecessors[currV];
+    auto it = predecessors.find(currV);
+    currV = (it == predecessors.end()) ? 0 : it->second;
   }
-  // Now push each item of the stack into the vector
-  while (!vStack.empty()) {
-    currV = vStack.top();
-    vStack.pop();
-    result.push_back(currV);
+  reverse(result.begin(), result.end());
+  if (stats) {
+    stats->PathNodes += result.size();
+  }
+  return result;
+}
+
+// Function getPathResult:
+// returns the path to an end vertex along with the coordinates
+// of every node on it and the total distance
+PathResult getPathResult(map<long long, long long>& predecessors,
+       map<long long, double>& distances, long long endV,
+       map<long long, Coordinates>& Nodes, RouteStats* stats = nullptr) {
+  PathResult result;
+  auto d = distances.find(endV);
+  if (d == distances.end() || d->second >= INF) {
+    return result;
+  }
+  result.Reachable = true;
+  result.Distance = d->second;
+  result.Nodes = getPath(predecessors, endV, stats);
+  statsTimer timer(stats ? &stats->UnpackMs : nullptr);
+  result.Coords.reserve(result.Nodes.size());
+  for (long long n : result.Nodes) {
+    result.Coords.push_back(Nodes.at(n));
   }
   return result;
 }
@@ -208,27 +315,40 @@ vector<long long> getPath(map<long long, long long>& predecessors,
 void printPath(vector<long long>& paths1, vector<long long>& paths2,
      map<long long, double>& distances1, map<long long, double>& distances2,
      long long& centerNode) {
+  // Build each path line in one buffer so it is written in one go
+  string line;
   cout << "Person 1's distance to dest: ";
   cout << distances1[centerNode] << " miles" << endl;
-  cout << "Path: ";
-  for (unsigned int i = 0; i < paths1.size(); i++) {
-    if (i == paths1.size()-1) {
-      cout << paths1[i] << endl;
-    } else {
-      cout << paths1[i] << "->";
-    }
-  }
+  line = "Path: ";
+  appendPathIds(paths1, line);
+  cout << line << endl;
 
   cout << endl;
 
   cout << "Person 2's distance to dest: ";
   cout << distances2[centerNode] << " miles" << endl;
-  cout << "Path: ";
-  for (unsigned int i = 0; i < paths2.size(); i++) {
-    if (i == paths2.size()-1) {
-      cout << paths2[i] << endl;
-    } else {
-      cout << paths2[i] << "->";
+  line = "Path: ";
+  appendPathIds(paths2, line);
+  cout << line << endl;
+}
+
+// Function buildFootGraph:
+// Adds every node as a vertex and every footway segment as an edge in
+// both directions, weighted by its length in miles
+template <typename GraphT>
+void buildFootGraph(GraphT& G, map<long long, Coordinates>& Nodes,
+     vector<FootwayInfo>& Footways) {
+  for (auto e : Nodes) {
+    G.addVertex(e.first);
+  }
+
+  for (auto f : Footways) {
+    for (unsigned int i = 0; i < f.Nodes.size()-1; i++) {
+      Coordinates c1 = Nodes[f.Nodes[i]];
+      Coordinates c2 = Nodes[f.Nodes[i+1]];
+      double dist = distBetween2Points(c1.Lat, c1.Lon, c2.Lat, c2.Lon);
+      G.addEdge(f.Nodes[i], f.Nodes[i+1], dist);
+      G.addEdge(f.Nodes[i+1], f.Nodes[i], dist);
     }
   }
 }
@@ -236,7 +356,7 @@ void printPath(vector<long long>& paths1, vector<long long>& paths2,
 //
 // Implement your creative component application here
 //
-void creative(graph<long long, double>& G,
+void creative(FootGraph& G,
     map<long long, Coordinates>& Nodes, vector<FootwayInfo>& Footways,
     vector<BuildingInfo>& Buildings) {
   string name;
@@ -262,6 +382,8 @@ void creative(graph<long long, double>& G,
 
   vector<BuildingInfo> allInfo;
   vector<long long> nearestNodes;
+  RouteStats queryStats;
+  RouteStats* qs = runStats.Enabled ? &queryStats : nullptr;
 
   // Get building info and nodes for all inputs
   for(unsigned int i = 0; i < names.size(); i++) {
@@ -272,7 +394,7 @@ void creative(graph<long long, double>& G,
     }
     allInfo.push_back(info);
  
-    long long nearest = nearestNode(allInfo[i], Nodes, Footways);
+    long long nearest = nearestNode(allInfo[i], Nodes, Footways, qs);
     nearestNodes.push_back(nearest);
   }
 
@@ -282,7 +404,7 @@ void creative(graph<long long, double>& G,
     cout << "Destination building not found" << endl;
     return;
   }
-  long long destNode = nearestNode(destInfo, Nodes, Footways);
+  long long destNode = nearestNode(destInfo, Nodes, Footways, qs);
 
   cout << "Destination:" << endl;
   cout << " " << destInfo.Fullname << endl;
@@ -302,7 +424,7 @@ void creative(graph<long long, double>& G,
   for(unsigned int i = 0; i < names.size(); i++) {
     map<long long, double> distances;
     map<long long, long long> predecessors;
-    vector<long long> search = dijkstra(nearestNodes[i], G, distances, predecessors);
+    vector<long long> search = dijkstra(nearestNodes[i], G, distances, predecessors, qs);
 
     cout << "Starting point:" << endl;
     cout << " " << allInfo[i].Fullname << endl;
@@ -320,31 +442,32 @@ void creative(graph<long long, double>& G,
     if(distances[destNode] >= INF) {
       cout << "Destination is unreachable for this person." << endl;
     } else {
-      vector<long long> paths = getPath(predecessors, destNode);
+      vector<long long> paths = getPath(predecessors, destNode, qs);
 
       cout << "This person's distance to dest: ";
       cout << distances[destNode] << " miles" << endl;
-      cout << "Path: ";
-      for (unsigned int j = 0; j < paths.size(); j++) {
-        if (j == paths.size()-1) {
-          cout << paths[j] << endl;
-        } else {
-          cout << paths[j] << "->";
-        }
-      }
+      string line = "Path: ";
+      appendPathIds(paths, line);
+      cout << line << endl;
     }
 
     cout << endl;
   }
+
+  if (qs) {
+    queryStats.Queries = names.size();
+    runStats.add(queryStats, 1);
+  }
 }
 
 //
 // Implement your standard application here
 //
-void application(graph<long long, double>& G,
+void application(FootGraph& G,
     map<long long, Coordinates>& Nodes, vector<FootwayInfo>& Footways,
     vector<BuildingInfo>& Buildings) {
   string person1Building, person2Building;
+  int queryCount = 0;
 
   cout << endl;
   cout << "Enter person 1's building (partial name or abbreviation), or #> ";
@@ -371,6 +494,9 @@ void application(graph<long long, double>& G,
     }
 
     if (validInput) {
+      RouteStats queryStats;
+      RouteStats* qs = runStats.Enabled ? &queryStats : nullptr;
+
       // Calculate the midpoint between the two buildings
       Coordinates midpoint;
       midpoint = centerBetween2Points(building1.Coords.Lat, building1.Coords.Lon, building2.Coords.Lat, building2.Coords.Lon);
@@ -379,18 +505,18 @@ void application(graph<long long, double>& G,
       BuildingInfo center = nearestBuilding(midpoint, Buildings, unreachableBuildings);
 
       // Find the nearest node to all three buildings
-      long long centerNode = nearestNode(center, Nodes, Footways);
-      long long nearestNode1 = nearestNode(building1, Nodes, Footways);
-      long long nearestNode2 = nearestNode(building2, Nodes, Footways);
+      long long centerNode = nearestNode(center, Nodes, Footways, qs);
+      long long nearestNode1 = nearestNode(building1, Nodes, Footways, qs);
+      long long nearestNode2 = nearestNode(building2, Nodes, Footways, qs);
 
       // Perform the dijkstra algorithm for each of the two nodes
       map<long long, double> distances1;
       map<long long, long long> predecessors1;
-      vector<long long> search1 = dijkstra(nearestNode1, G, distances1, predecessors1);
+      vector<long long> search1 = dijkstra(nearestNode1, G, distances1, predecessors1, qs);
 
       map<long long, double> distances2;
       map<long long, long long> predecessors2;
-      vector<long long> search2 = dijkstra(nearestNode2, G, distances2, predecessors2);
+      vector<long long> search2 = dijkstra(nearestNode2, G, distances2, predecessors2, qs);
 
       // Print out all of the information found at this point
       cout << "Person 1's point:" << endl;
@@ -440,7 +566,7 @@ void application(graph<long long, double>& G,
         cout << endl;
 
         BuildingInfo nextCenter = nearestBuilding(midpoint, Buildings, unreachableBuildings);
-        centerNode = nearestNode(nextCenter, Nodes, Footways);
+        centerNode = nearestNode(nextCenter, Nodes, Footways, qs);
 
         cout << "New destination building:" << endl;
         cout << " " << nextCenter.Fullname << endl;
@@ -461,7 +587,7 @@ void application(graph<long long, double>& G,
           cout << endl;
 
           nextCenter = nearestBuilding(midpoint, Buildings, unreachableBuildings);
-          centerNode = nearestNode(nextCenter, Nodes, Footways);
+          centerNode = nearestNode(nextCenter, Nodes, Footways, qs);
 
           cout << "New destination building:" << endl;
           cout << " " << nextCenter.Fullname << endl;
@@ -475,24 +601,29 @@ void application(graph<long long, double>& G,
 
           cout << endl;
 
-          vector<long long> paths1 = getPath(predecessors1, centerNode);
-          vector<long long> paths2 = getPath(predecessors2, centerNode);
+          vector<long long> paths1 = getPath(predecessors1, centerNode, qs);
+          vector<long long> paths2 = getPath(predecessors2, centerNode, qs);
 
           printPath(paths1, paths2, distances1, distances2, centerNode);
         } else {
-          vector<long long> paths1 = getPath(predecessors1, centerNode);
-          vector<long long> paths2 = getPath(predecessors2, centerNode);
+          vector<long long> paths1 = getPath(predecessors1, centerNode, qs);
+          vector<long long> paths2 = getPath(predecessors2, centerNode, qs);
 
           printPath(paths1, paths2, distances1, distances2, centerNode);
         }
 
       } else {
         // Find and print the paths to the center node
-        vector<long long> paths1 = getPath(predecessors1, centerNode);
-        vector<long long> paths2 = getPath(predecessors2, centerNode);
+        vector<long long> paths1 = getPath(predecessors1, centerNode, qs);
+        vector<long long> paths2 = getPath(predecessors2, centerNode, qs);
 
         printPath(paths1, paths2, distances1, distances2, centerNode);
       }
+
+      if (qs) {
+        queryStats.Queries = 1;
+        runStats.add(queryStats, ++queryCount);
+      }
     }
 
 
@@ -505,7 +636,441 @@ void application(graph<long long, double>& G,
   }
 }
 
-int main() {
+// Function dumpStats:
+// Writes the run-wide stats to cerr as JSON if --stats was given
+void dumpStats() {
+  if (runStats.Enabled) {
+    cerr << runStats.totals().toJSON() << endl;
+  }
+}
+
+//
+// Batch mode
+//
+
+// Queries are read and answered this many at a time, so memory stays
+// bounded no matter how long the query file is
+const int BATCH_BLOCK_SIZE = 4096;
+
+// Class buildingCache:
+// searchBuilding and nearestNode are linear scans, so this remembers
+// the building and nearest node each query string resolved to.  It is
+// safe to share between threads.
+class buildingCache {
+ private:
+  map<long long, Coordinates>& Nodes;
+  vector<FootwayInfo>& Footways;
+  vector<BuildingInfo>& Buildings;
+  map<string, pair<BuildingInfo, long long>> resolved;
+  mutex lock;
+
+ public:
+  buildingCache(map<long long, Coordinates>& nodes,
+      vector<FootwayInfo>& footways, vector<BuildingInfo>& buildings)
+    : Nodes(nodes), Footways(footways), Buildings(buildings) {
+  }
+
+  // Returns the nearest node of the building matching query (and the
+  // building through info), or -1 if no building matches.  The lock is
+  // only held to read or add a cache entry; the searches run outside it,
+  // so a slow lookup does not hold up the others.  Two threads missing on
+  // the same query both search, and the first to add its entry wins.
+  long long resolve(const string& query, BuildingInfo& info,
+                   RouteStats* stats = nullptr) {
+    {
+      lock_guard<mutex> guard(lock);
+      auto it = resolved.find(query);
+      if (it != resolved.end()) {
+        info = it->second.first;
+        return it->second.second;
+      }
+    }
+    BuildingInfo b;
+    long long node = -1;
+    if (query != "" && searchBuilding(query, b, Buildings)) {
+      node = nearestNode(b, Nodes, Footways, stats);
+    }
+    lock_guard<mutex> guard(lock);
+    auto it = resolved.emplace(query, make_pair(b, node)).first;
+    info = it->second.first;
+    return it->second.second;
+  }
+
+  // Returns the building closest to c and its nearest node.  Nothing is
+  // cached, and the map data is only read, so no lock is needed.
+  long long nearest(Coordinates c, BuildingInfo& info,
+                   RouteStats* stats = nullptr) {
+    set<string> unreachableBuildings;
+    info = nearestBuilding(c, Buildings, unreachableBuildings);
+    return nearestNode(info, Nodes, Footways, stats);
+  }
+};
+
+struct BatchQuery {
+  int Line;
+  bool Found;
+  long long FromNode;
+  long long ToNode;
+  string Result;  // formatted output line
+};
+
+// Function trim:
+// Returns the string without leading/trailing whitespace
+string trim(const string& s) {
+  size_t first = s.find_first_not_of(" \t\r\n");
+  if (first == string::npos) {
+    return "";
+  }
+  size_t last = s.find_last_not_of(" \t\r\n");
+  return s.substr(first, last - first + 1);
+}
+
+// Function formatBatchResult:
+// Fills in the output line of a query from its path
+void formatBatchResult(BatchQuery& q, const PathResult& path) {
+  q.Result = to_string(q.Line);
+  if (!q.Found) {
+    q.Result += "\tNOT_FOUND\t\t\t";
+  } else if (!path.Reachable) {
+    q.Result += "\tUNREACHABLE\t\t\t";
+  } else {
+    q.Result += "\tOK\t";
+    appendNumber(q.Result, "%.8g", path.Distance);
+    q.Result += '\t';
+    q.Result += to_string(path.Nodes.size());
+    q.Result += '\t';
+    encodePolyline(path, q.Result);
+  }
+}
+
+// Function routeBatchBlock:
+// Routes a block of queries on numThreads threads.  Queries are grouped
+// by starting node so dijkstra runs once per distinct start.
+void routeBatchBlock(vector<BatchQuery>& block, FootGraph& G,
+     map<long long, Coordinates>& Nodes, int numThreads) {
+  map<long long, vector<int>> bySource;
+  for (unsigned int i = 0; i < block.size(); i++) {
+    if (block[i].Found) {
+      bySource[block[i].FromNode].push_back(i);
+    } else {
+      formatBatchResult(block[i], PathResult());
+    }
+  }
+
+  vector<const pair<const long long, vector<int>>*> sources;
+  for (const auto& e : bySource) {
+    sources.push_back(&e);
+  }
+
+  // Each thread takes the next unclaimed start node until none are left;
+  // the graph and node map are only read, and each query is written by
+  // exactly one thread
+  atomic<size_t> next(0);
+  auto worker = [&]() {
+    size_t k;
+    while ((k = next++) < sources.size()) {
+      // The search is charged to the first query that needed it; the
+      // rest of the group only pay for unpacking their path
+      RouteStats queryStats;
+      RouteStats* qs = runStats.Enabled ? &queryStats : nullptr;
+      map<long long, double> distances;
+      map<long long, long long> predecessors;
+      dijkstra(sources[k]->first, G, distances, predecessors, qs);
+      for (int q : sources[k]->second) {
+        PathResult path = getPathResult(predecessors, distances, block[q].ToNode, Nodes, qs);
+        formatBatchResult(block[q], path);
+        if (qs) {
+          queryStats.Queries = 1;
+          runStats.add(queryStats, block[q].Line);
+          queryStats = RouteStats();
+        }
+      }
+    }
+  };
+
+  vector<thread> threads;
+  for (int t = 1; t < numThreads; t++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+// Function batch:
+// Reads building pairs from queries, routes them in parallel a block
+// at a time, and streams the results in input order
+void batch(FootGraph& G, map<long long, Coordinates>& Nodes,
+    vector<FootwayInfo>& Footways, vector<BuildingInfo>& Buildings,
+    istream& queries, ostream& results, int numThreads) {
+  buildingCache cache(Nodes, Footways, Buildings);
+  BuildingInfo info;
+  RouteStats snapStats;
+  RouteStats* ss = runStats.Enabled ? &snapStats : nullptr;
+
+  auto start = chrono::steady_clock::now();
+  vector<BatchQuery> block;
+  block.reserve(BATCH_BLOCK_SIZE);
+  string line;
+  int lineNo = 0;
+  int total = 0;
+
+  while (true) {
+    bool more = static_cast<bool>(getline(queries, line));
+    if (more) {
+      lineNo++;
+      line = trim(line);
+      if (line == "" || line[0] == '#') {
+        continue;
+      }
+      BatchQuery q;
+      q.Line = lineNo;
+      size_t bar = line.find('|');
+      q.FromNode = (bar == string::npos) ? -1 : cache.resolve(trim(line.substr(0, bar)), info, ss);
+      q.ToNode = (bar == string::npos) ? -1 : cache.resolve(trim(line.substr(bar + 1)), info, ss);
+      q.Found = (q.FromNode != -1 && q.ToNode != -1);
+      block.push_back(q);
+    }
+
+    if (block.size() == BATCH_BLOCK_SIZE || (!more && !block.empty())) {
+      routeBatchBlock(block, G, Nodes, numThreads);
+      for (const BatchQuery& q : block) {
+        results << q.Result << '\n';
+      }
+      results.flush();
+      total += block.size();
+      block.clear();
+    }
+
+    if (!more) {
+      break;
+    }
+  }
+
+  // Snapping is cached across queries, so it only shows in the totals
+  if (ss) {
+    runStats.add(snapStats, -1);
+  }
+
+  double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  cerr << "# of queries: " << total << endl;
+  cerr << "Batch time: " << secs << " s (" << numThreads << " threads)" << endl;
+}
+
+//
+// Server mode
+//
+
+// Function appendJSONString:
+// Appends s to out as a quoted, escaped JSON string
+void appendJSONString(const string& s, string& out) {
+  out += '"';
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out += buf;
+    } else {
+      out += c;
+    }
+  }
+  out += '"';
+}
+
+// Function appendBuildingJSON:
+// Appends a building and its nearest node as a JSON object
+void appendBuildingJSON(const BuildingInfo& b, long long node, string& out) {
+  out += "{\"name\":";
+  appendJSONString(b.Fullname, out);
+  out += ",\"abbrev\":";
+  appendJSONString(b.Abbrev, out);
+  out += ",\"lat\":";
+  appendNumber(out, "%.7f", b.Coords.Lat);
+  out += ",\"lon\":";
+  appendNumber(out, "%.7f", b.Coords.Lon);
+  out += ",\"node\":";
+  out += to_string(node);
+  out += "}";
+}
+
+// Function serve:
+// Answers route and nearest-building requests over HTTP until killed
+void serve(FootGraph& G, map<long long, Coordinates>& Nodes,
+    vector<FootwayInfo>& Footways, vector<BuildingInfo>& Buildings,
+    int port, int numThreads) {
+  buildingCache cache(Nodes, Footways, Buildings);
+  httpserver server(port, numThreads);
+  atomic<long long> requestCount(0);
+  runStats.Enabled = true;
+
+  server.route("/route", [&](const HttpRequest& req, HttpResponse& res) {
+    BuildingInfo from, to;
+    auto f = req.Query.find("from");
+    auto t = req.Query.find("to");
+    if (f == req.Query.end() || t == req.Query.end()) {
+      res.Status = 400;
+      res.Body = "{\"error\":\"from and to are required\"}";
+      return;
+    }
+    RouteStats queryStats;
+    long long fromNode = cache.resolve(f->second, from, &queryStats);
+    long long toNode = cache.resolve(t->second, to, &queryStats);
+    if (fromNode == -1 || toNode == -1) {
+      res.Status = 404;
+      res.Body = "{\"error\":\"building not found\"}";
+      return;
+    }
+
+    map<long long, double> distances;
+    map<long long, long long> predecessors;
+    dijkstra(fromNode, G, distances, predecessors, &queryStats);
+    PathResult path = getPathResult(predecessors, distances, toNode, Nodes, &queryStats);
+    queryStats.Queries = 1;
+    runStats.add(queryStats, ++requestCount);
+
+    res.Body = "{\"from\":";
+    appendBuildingJSON(from, fromNode, res.Body);
+    res.Body += ",\"to\":";
+    appendBuildingJSON(to, toNode, res.Body);
+    // Both buildings exist but no footway connects them
+    if (!path.Reachable) {
+      res.Status = 404;
+      res.Body += ",\"error\":\"no route between the buildings\"}";
+      return;
+    }
+    res.Body += ",\"polyline\":";
+    string polyline;
+    encodePolyline(path, polyline);
+    appendJSONString(polyline, res.Body);
+    res.Body += ",\"route\":";
+    writeGeoJSON(path, res.Body);
+    res.Body += "}";
+  });
+
+  server.route("/nearest", [&](const HttpRequest& req, HttpResponse& res) {
+    auto lat = req.Query.find("lat");
+    auto lon = req.Query.find("lon");
+    Coordinates c;
+    try {
+      if (lat == req.Query.end() || lon == req.Query.end()) {
+        throw invalid_argument("missing");
+      }
+      c.Lat = stod(lat->second);
+      c.Lon = stod(lon->second);
+    } catch (logic_error&) {
+      res.Status = 400;
+      res.Body = "{\"error\":\"lat and lon are required numbers\"}";
+      return;
+    }
+    BuildingInfo b;
+    RouteStats queryStats;
+    long long node = cache.nearest(c, b, &queryStats);
+    runStats.add(queryStats, ++requestCount);
+    res.Body = "{\"building\":";
+    appendBuildingJSON(b, node, res.Body);
+    res.Body += "}";
+  });
+
+  server.route("/metrics", [&](const HttpRequest&, HttpResponse& res) {
+    res.Body = server.metricsJSON();
+  });
+
+  server.route("/stats", [&](const HttpRequest&, HttpResponse& res) {
+    res.Body = runStats.totals().toJSON();
+  });
+
+  if (!server.start()) {
+    cerr << "**Error: unable to listen on 127.0.0.1:" << port << endl;
+    return;
+  }
+  cerr << "Listening on http://127.0.0.1:" << server.port() << "/" << endl;
+  server.run();
+}
+
+// Function countEdges:
+// Returns the # of edges on the path to v in a predecessors map
+long long countEdges(map<long long, long long>& predecessors, long long v) {
+  long long edges = 0;
+  for (auto it = predecessors.find(v); it != predecessors.end() && it->second != 0;
+       it = predecessors.find(it->second)) {
+    edges++;
+  }
+  return edges;
+}
+
+// Function checkGraph:
+// Runs dijkstra on C from every source and compares each distance with
+// the double graph's.  tolerance(d, edges) is the largest difference
+// allowed for a path of length d with that many edges.  Prints the
+// largest difference seen and returns false if any was too large.
+template <typename GraphT, typename ToleranceF>
+bool checkGraph(const string& label, FootGraph& G, GraphT& C,
+     const vector<long long>& sources, ToleranceF tolerance) {
+  double maxError = 0;
+  long long compared = 0, failures = 0;
+  for (long long s : sources) {
+    map<long long, double> exact, approx;
+    map<long long, long long> exactPred, approxPred;
+    dijkstra(s, G, exact, exactPred);
+    dijkstra(s, C, approx, approxPred);
+    for (auto& e : exact) {
+      double a = approx.count(e.first) ? approx[e.first] : -1;
+      if ((e.second >= INF) != (a >= INF)) {
+        failures++;  // reachable in one graph but not the other
+        continue;
+      }
+      if (e.second >= INF) {
+        continue;
+      }
+      // Either graph may have picked the other of two near-equal paths,
+      // so allow for the longer of the two
+      long long edges = max(countEdges(exactPred, e.first), countEdges(approxPred, e.first));
+      double error = fabs(a - e.second);
+      maxError = max(maxError, error);
+      if (error > tolerance(e.second, edges)) {
+        failures++;
+      }
+      compared++;
+    }
+  }
+  cout << label << ": " << compared << " distances, largest difference "
+       << maxError * 1609344.0 << " mm, " << failures << " over tolerance" << endl;
+  return failures == 0 && G.NumVertices() == C.NumVertices();
+}
+
+// Function checkGraphs:
+// Builds the float and mmweight compact graphs from the same map as G
+// and checks their dijkstra distances against G's
+bool checkGraphs(FootGraph& G, map<long long, Coordinates>& Nodes,
+     vector<FootwayInfo>& Footways, vector<BuildingInfo>& Buildings,
+     int maxSources) {
+  compactgraph<long long, float> floatGraph;
+  compactgraph<long long, mmweight> mmGraph;
+  buildFootGraph(floatGraph, Nodes, Footways);
+  buildFootGraph(mmGraph, Nodes, Footways);
+
+  vector<long long> sources;
+  for (auto& b : Buildings) {
+    if ((int) sources.size() < maxSources) {
+      sources.push_back(nearestNode(b, Nodes, Footways));
+    }
+  }
+
+  // float: each edge within 2^-24 of its length, so a route within 2^-24
+  // of its total distance (summed in double, plus a little for that rounding)
+  bool floatOk = checkGraph("compactgraph<long long, float>   ", G, floatGraph, sources,
+      [](double d, long long) { return d * ldexp(1.0, -24) + d * 1e-15; });
+  // mmweight: each edge within half a millimeter
+  bool mmOk = checkGraph("compactgraph<long long, mmweight>", G, mmGraph, sources,
+      [](double d, long long edges) { return (edges * 0.5) / mmweight::MM_PER_MILE + d * 1e-15; });
+  return floatOk && mmOk;
+}
+
+int main(int argc, char* argv[]) {
   // maps a Node ID to it's coordinates (lat, lon)
   map<long long, Coordinates>  Nodes;
   // info about each footway, in no particular order
@@ -514,27 +1079,64 @@ int main() {
   vector<BuildingInfo>         Buildings;
   XMLDocument                  xmldoc;
 
-  cout << "** Navigating UIC open street map **" << endl;
-  cout << endl;
+  // Batch and server mode take everything from the command line and
+  // keep stdout free for results, so the console messages go to cerr
+  // --stats / --stats=query may appear anywhere, so pull them out first
+  vector<string> args;
+  for (int i = 0; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--stats" || arg == "--stats=query") {
+      runStats.Enabled = true;
+      runStats.PerQuery = (arg == "--stats=query");
+    } else {
+      args.push_back(arg);
+    }
+  }
+  int nargs = static_cast<int>(args.size());
+
+  string mode = (nargs >= 2) ? args[1] : "";
+  bool batchMode = (mode == "--batch");
+  bool serveMode = (mode == "--serve");
+  bool checkMode = (mode == "--check-graphs");
+  if ((batchMode && nargs < 5) || ((serveMode || checkMode) && nargs < 3)) {
+    cerr << "usage: " << args[0]
+         << " --batch map.osm queries.txt results.txt [threads] [--stats[=query]]" << endl;
+    cerr << "       " << args[0]
+         << " --serve map.osm [port] [threads] [--stats[=query]]" << endl;
+    cerr << "       " << args[0] << " --check-graphs map.osm [sources]" << endl;
+    return 1;
+  }
+  ostream& out = (batchMode || serveMode || checkMode) ? cerr : cout;
+
+  out << "** Navigating UIC open street map **" << endl;
+  out << endl;
   cout << std::setprecision(8);
+  cerr << std::setprecision(8);
 
   string def_filename = "map.osm";
   string filename;
 
-  cout << "Enter map filename> ";
-  getline(cin, filename);
+  if (batchMode || serveMode || checkMode) {
+    filename = args[2];
+  } else {
+    cout << "Enter map filename> ";
+    getline(cin, filename);
+  }
 
   if (filename == "") {
     filename = def_filename;
   }
 
+  RouteStats loadStats;
+  auto loadStart = chrono::steady_clock::now();
+
   //
   // Load XML-based map file
   //
   if (!LoadOpenStreetMap(filename, xmldoc)) {
-    cout << "**Error: unable to load open street map." << endl;
-    cout << endl;
-    return 0;
+    out << "**Error: unable to load open street map." << endl;
+    out << endl;
+    return (batchMode || serveMode || checkMode) ? 1 : 0;
   }
 
   //
@@ -552,6 +1154,9 @@ int main() {
   //
   int buildingCount = ReadUniversityBuildings(xmldoc, Nodes, Buildings);
 
+  auto buildStart = chrono::steady_clock::now();
+  loadStats.LoadMs = chrono::duration<double, milli>(buildStart - loadStart).count();
+
   //
   // Stats
   //
@@ -559,35 +1164,69 @@ int main() {
   assert(footwayCount == (int)Footways.size());
   assert(buildingCount == (int)Buildings.size());
 
-  cout << endl;
-  cout << "# of nodes: " << Nodes.size() << endl;
-  cout << "# of footways: " << Footways.size() << endl;
-  cout << "# of buildings: " << Buildings.size() << endl;
+  out << endl;
+  out << "# of nodes: " << Nodes.size() << endl;
+  out << "# of footways: " << Footways.size() << endl;
+  out << "# of buildings: " << Buildings.size() << endl;
 
 
   //
   // TO DO: build the graph, output stats:
   //
-  graph<long long, double> G;
+  FootGraph G;
+  buildFootGraph(G, Nodes, Footways);
 
-  for (auto e : Nodes) {
-    G.addVertex(e.first);
+
+  loadStats.BuildMs = chrono::duration<double, milli>(chrono::steady_clock::now() - buildStart).count();
+  runStats.add(loadStats, -1);
+
+  out << "# of vertices: " << G.NumVertices() << endl;
+  out << "# of edges: " << G.NumEdges() << endl;
+  out << endl;
+
+  if (checkMode) {
+    int maxSources = (nargs >= 4) ? atoi(args[3].c_str()) : static_cast<int>(Buildings.size());
+    return checkGraphs(G, Nodes, Footways, Buildings, maxSources) ? 0 : 1;
   }
 
-  for (auto f : Footways) {
-    for (unsigned int i = 0; i < f.Nodes.size()-1; i++) {
-      Coordinates c1 = Nodes[f.Nodes[i]];
-      Coordinates c2 = Nodes[f.Nodes[i+1]];
-      double dist = distBetween2Points(c1.Lat, c1.Lon, c2.Lat, c2.Lon);
-      G.addEdge(f.Nodes[i], f.Nodes[i+1], dist);
-      G.addEdge(f.Nodes[i+1], f.Nodes[i], dist);
-    }
+  if (serveMode) {
+    int port = (nargs >= 4) ? atoi(args[3].c_str()) : 8080;
+    int numThreads = (nargs >= 5) ? atoi(args[4].c_str()) : static_cast<int>(thread::hardware_concurrency());
+    serve(G, Nodes, Footways, Buildings, port, numThreads);
+    return 1;
   }
 
+  if (batchMode) {
+    int numThreads = (nargs >= 6) ? atoi(args[5].c_str()) : static_cast<int>(thread::hardware_concurrency());
+    if (numThreads < 1) {
+      numThreads = 1;
+    }
 
-  cout << "# of vertices: " << G.NumVertices() << endl;
-  cout << "# of edges: " << G.NumEdges() << endl;
-  cout << endl;
+    ifstream queryFile;
+    ofstream resultFile;
+    string queryName = args[3];
+    string resultName = args[4];
+    if (queryName != "-") {
+      queryFile.open(queryName);
+      if (!queryFile.is_open()) {
+        cerr << "**Error: unable to open " << queryName << endl;
+        return 1;
+      }
+    }
+    if (resultName != "-") {
+      resultFile.open(resultName);
+      if (!resultFile.is_open()) {
+        cerr << "**Error: unable to open " << resultName << endl;
+        return 1;
+      }
+    }
+    istream& queries = (queryName == "-") ? cin : queryFile;
+    ostream& results = (resultName == "-") ? cout : resultFile;
+
+    batch(G, Nodes, Footways, Buildings, queries, results, numThreads);
+    dumpStats();
+    return 0;
+  }
 
   //
   // Menu
@@ -605,5 +1244,6 @@ int main() {
   // done:
   //
   cout << "** Done **" << endl;
+  dumpStats();
   return 0;
 }
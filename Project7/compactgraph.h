@@ -0,0 +1,295 @@
+// compactgraph.h
+// Shayan Rasheed
+//
+// Compact graph class for large footway networks
+//
+// University of Illinois at Chicago
+// CS 251: Fall 2021
+// Project #7 - Openstreet Maps
+//
+// Same interface as graph<VertexT, WeightT>, but every vertex is given a
+// dense index of type IndexT (32 bits by default) and edges are stored as
+// (index, weight) pairs in one vector per vertex instead of a set per vertex
+// inside a map.  With IndexT = unsigned int and WeightT = float or mmweight
+// an edge costs 8 bytes instead of a red-black tree node (~48 bytes).
+//
+// Tolerance:
+//   - float stores each edge with a relative error of at most 2^-24
+//     (about 6e-8), so a route's total distance is off by at most 2^-24
+//     of that total (about 0.1 mm per mile), however many edges it has.
+//   - mmweight stores each edge rounded to the nearest millimeter, so a
+//     route of k edges is off by at most k * 0.5 mm in total.
+// Path lengths are summed in double by dijkstra, so no error accumulates
+// beyond the per-edge rounding.  The chosen path can only differ from the
+// double graph when two routes are equal to within that tolerance.
+// application.exe --check-graphs compares every distance against these
+// bounds.
+//
+
+#pragma once
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+//
+// mmweight
+//
+// Fixed-point edge weight: a distance in miles stored as a whole
+// number of millimeters in 32 bits (max ~2668 miles per edge).
+//
+struct mmweight {
+  static constexpr double MM_PER_MILE = 1609344.0;
+
+  unsigned int mm;
+
+  mmweight() : mm(0) {
+  }
+
+  mmweight(double miles) {
+    double scaled = std::round(miles * MM_PER_MILE);
+    if (scaled < 0 || scaled > numeric_limits<unsigned int>::max()) {
+      throw out_of_range("mmweight: edge weight out of range");
+    }
+    mm = static_cast<unsigned int>(scaled);
+  }
+
+  operator double() const {
+    return mm / MM_PER_MILE;
+  }
+};
+
+template<typename VertexT, typename WeightT, typename IndexT = unsigned int>
+class compactgraph {
+ public:
+  typedef VertexT vertex_type;
+  typedef WeightT weight_type;
+
+ private:
+  struct edge {
+    IndexT to;
+    WeightT weight;
+  };
+  vector<VertexT> Vertices;              // index -> vertex
+  vector<pair<VertexT, IndexT>> lookup;  // vertex -> index, sorted by vertex
+  vector<vector<edge>> adjList;          // index -> outgoing edges
+
+  //
+  // indexOf
+  //
+  // Finds the dense index of v.  Returns false if v is not in the graph.
+  //
+  bool indexOf(VertexT v, IndexT& index) const {
+    auto it = lower_bound(lookup.begin(), lookup.end(), v,
+        [](const pair<VertexT, IndexT>& p, const VertexT& key) {
+          return p.first < key;
+        });
+    if (it == lookup.end() || it->first != v) {
+      return false;
+    }
+    index = it->second;
+    return true;
+  }
+
+ public:
+  //
+  // constructor:
+  //
+  // Constructs an empty graph.
+  //
+  compactgraph() {
+  }
+
+  //
+  // reserve
+  //
+  // Preallocates room for n vertices so loading a large map does not
+  // repeatedly grow the vertex arrays.
+  //
+  void reserve(int n) {
+    Vertices.reserve(n);
+    lookup.reserve(n);
+    adjList.reserve(n);
+  }
+
+  //
+  // NumVertices
+  //
+  // Returns the # of vertices currently in the graph.
+  //
+  int NumVertices() const {
+    return static_cast<int>(this->Vertices.size());
+  }
+
+  //
+  // NumEdges
+  //
+  // Returns the # of edges currently in the graph.
+  //
+  int NumEdges() const {
+    int count = 0;
+
+    for (const auto& edges : adjList) {
+      count += edges.size();
+    }
+
+    return count;
+  }
+
+  //
+  // addVertex
+  //
+  // Adds the vertex v to the graph and returns true.  If the vertex
+  // already exists, or the index type cannot address another vertex,
+  // false is returned.
+  //
+  bool addVertex(VertexT v) {
+    if (Vertices.size() >= static_cast<size_t>(numeric_limits<IndexT>::max())) {
+      return false;
+    }
+
+    IndexT newIndex = static_cast<IndexT>(Vertices.size());
+
+    // Vertices usually arrive in sorted order, so appending is the fast path
+    if (lookup.empty() || lookup.back().first < v) {
+      lookup.push_back(make_pair(v, newIndex));
+    } else {
+      auto it = lower_bound(lookup.begin(), lookup.end(), v,
+          [](const pair<VertexT, IndexT>& p, const VertexT& key) {
+            return p.first < key;
+          });
+      if (it != lookup.end() && it->first == v) {
+        return false;
+      }
+      lookup.insert(it, make_pair(v, newIndex));
+    }
+
+    this->Vertices.push_back(v);
+    adjList.push_back(vector<edge>());
+
+    return true;
+  }
+
+  //
+  // addEdge
+  //
+  // Adds the edge (from, to, weight) to the graph, and returns
+  // true.  If the vertices do not exist, false is returned.
+  //
+  // NOTE: if the edge already exists, the existing edge weight
+  // is overwritten with the new edge weight.
+  //
+  bool addEdge(VertexT from, VertexT to, WeightT weight) {
+    IndexT fromIndex, toIndex;
+    if (!indexOf(from, fromIndex) || !indexOf(to, toIndex)) {
+      return false;
+    }
+
+    // Footway vertices have only a handful of edges, so a scan is cheap
+    for (auto& e : adjList[fromIndex]) {
+      if (e.to == toIndex) {
+        e.weight = weight;
+        return true;
+      }
+    }
+
+    edge newEdge;
+    newEdge.to = toIndex;
+    newEdge.weight = weight;
+    adjList[fromIndex].push_back(newEdge);
+
+    return true;
+  }
+
+  //
+  // getWeight
+  //
+  // Returns the weight associated with a given edge.  If
+  // the edge exists, the weight is returned via the reference
+  // parameter and true is returned.  If the edge does not
+  // exist, the weight parameter is unchanged and false is
+  // returned.
+  //
+  bool getWeight(VertexT from, VertexT to, WeightT& weight) const {
+    IndexT fromIndex, toIndex;
+    if (!indexOf(from, fromIndex) || !indexOf(to, toIndex)) {
+      return false;
+    }
+
+    for (const auto& e : adjList[fromIndex]) {
+      if (e.to == toIndex) {
+        weight = e.weight;
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  //
+  // neighbors
+  //
+  // Returns a set containing the neighbors of v, i.e. all
+  // vertices that can be reached from v along one edge.
+  //
+  set<VertexT> neighbors(VertexT v) const {
+    set<VertexT> S;
+    IndexT index;
+    if (!indexOf(v, index)) {
+      return S;
+    }
+
+    for (const auto& e : adjList[index]) {
+      S.emplace(Vertices[e.to]);
+    }
+
+    return S;
+  }
+
+  //
+  // getVertices
+  //
+  // Returns a vector containing all the vertices currently in
+  // the graph.
+  //
+  vector<VertexT> getVertices() const {
+    return this->Vertices;  // returns a copy:
+  }
+
+  //
+  // dump
+  //
+  // Dumps the internal state of the graph for debugging purposes.
+  //
+  void dump(ostream& output) const {
+    output << "***************************************************" << endl;
+    output << "***************** COMPACT GRAPH *******************" << endl;
+
+    output << "**Num vertices: " << this->NumVertices() << endl;
+    output << "**Num edges: " << this->NumEdges() << endl;
+
+    output << endl;
+    output << "**Vertices:" << endl;
+    for (int i = 0; i < this->NumVertices(); ++i) {
+      output << " " << i << ". " << this->Vertices[i] << endl;
+    }
+
+    output << endl;
+    output << "**Edges:" << endl;
+    for (size_t i = 0; i < Vertices.size(); ++i) {
+      output << Vertices[i] << ": ";
+      for (const auto& e : adjList[i]) {
+        output << "(" << Vertices[i] << ", " << Vertices[e.to] << ", "
+               << static_cast<double>(e.weight) << ") ";
+      }
+      output << endl;
+    }
+    output << "**************************************************" << endl;
+  }
+};
@@ -20,6 +20,10 @@ using namespace std;
 
 template<typename VertexT, typename WeightT>
 class graph {
+ public:
+  typedef VertexT vertex_type;
+  typedef WeightT weight_type;
+
  private:
   struct node {
     VertexT vertex;
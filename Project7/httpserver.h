@@ -0,0 +1,494 @@
+// httpserver.h
+// Shayan Rasheed
+//
+// Minimal loopback HTTP/1.1 server with a thread pool
+//
+// University of Illinois at Chicago
+// CS 251: Fall 2021
+// Project #7 - Openstreet Maps
+//
+// Only GET requests are supported and every response closes the
+// connection.  The server binds to 127.0.0.1 so it is never reachable
+// from another machine.  One thread accepts connections and hands them
+// to a fixed pool of worker threads, which parse the request, call the
+// handler registered for its path and write the response.  The latency
+// of every request is recorded per path and reported by metricsJSON().
+//
+// A client gets a fixed time to send its request line and headers; one
+// that stays idle (or sends them a byte at a time) is closed when it runs
+// out, so a few idle connections cannot hold every worker.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+using namespace std;
+
+// Time a connection has to send its request line and headers
+const int HTTP_READ_TIMEOUT_MS = 5000;
+// Longest a response write may block on a client that is not reading
+const int HTTP_WRITE_TIMEOUT_MS = 5000;
+
+struct HttpRequest {
+  string Method;
+  string Path;
+  map<string, string> Query;
+};
+
+struct HttpResponse {
+  int Status;
+  string ContentType;
+  string Body;
+
+  HttpResponse() {
+    Status = 200;
+    ContentType = "application/json";
+  }
+};
+
+typedef function<void(const HttpRequest&, HttpResponse&)> HttpHandler;
+
+class httpserver {
+ private:
+  // Latency of requests to one path.  Bucket i counts requests that
+  // took less than 2^i microseconds, which is enough for percentiles.
+  struct pathMetrics {
+    long long count;
+    long long errors;
+    double totalUs;
+    double maxUs;
+    long long buckets[32];
+
+    pathMetrics() {
+      count = 0;
+      errors = 0;
+      totalUs = 0;
+      maxUs = 0;
+      memset(buckets, 0, sizeof(buckets));
+    }
+  };
+
+  int listenFd;
+  int portNum;
+  int numThreads;
+  int readTimeoutMs;
+  atomic<bool> running;
+
+  map<string, HttpHandler> handlers;
+
+  queue<int> pending;  // accepted connections waiting for a worker
+  mutex pendingLock;
+  condition_variable pendingReady;
+  vector<thread> workers;
+
+  map<string, pathMetrics> metrics;
+  mutable mutex metricsLock;
+
+  //
+  // urlDecode
+  //
+  // Decodes %XX escapes and '+' (space) in a query string component.
+  //
+  static string urlDecode(const string& s) {
+    string result;
+    result.reserve(s.size());
+    for (size_t i = 0; i < s.size(); i++) {
+      if (s[i] == '+') {
+        result += ' ';
+      } else if (s[i] == '%' && i + 2 < s.size() &&
+                 isxdigit(static_cast<unsigned char>(s[i+1])) &&
+                 isxdigit(static_cast<unsigned char>(s[i+2]))) {
+        result += static_cast<char>(stoi(s.substr(i + 1, 2), nullptr, 16));
+        i += 2;
+      } else {
+        result += s[i];
+      }
+    }
+    return result;
+  }
+
+  //
+  // parseRequest
+  //
+  // Parses the request line "GET /path?a=1&b=2 HTTP/1.1".  Returns false
+  // if the line is malformed.
+  //
+  static bool parseRequest(const string& raw, HttpRequest& request) {
+    size_t lineEnd = raw.find("\r\n");
+    string line = raw.substr(0, lineEnd);
+    size_t sp1 = line.find(' ');
+    size_t sp2 = line.find(' ', sp1 + 1);
+    if (sp1 == string::npos || sp2 == string::npos) {
+      return false;
+    }
+    request.Method = line.substr(0, sp1);
+    string target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+
+    size_t q = target.find('?');
+    request.Path = target.substr(0, q);
+    if (q != string::npos) {
+      string query = target.substr(q + 1);
+      size_t pos = 0;
+      while (pos <= query.size()) {
+        size_t amp = query.find('&', pos);
+        if (amp == string::npos) {
+          amp = query.size();
+        }
+        string pair = query.substr(pos, amp - pos);
+        size_t eq = pair.find('=');
+        if (pair != "") {
+          if (eq == string::npos) {
+            request.Query[urlDecode(pair)] = "";
+          } else {
+            request.Query[urlDecode(pair.substr(0, eq))] = urlDecode(pair.substr(eq + 1));
+          }
+        }
+        pos = amp + 1;
+      }
+    }
+    return true;
+  }
+
+  static const char* statusText(int status) {
+    switch (status) {
+      case 200: return "OK";
+      case 400: return "Bad Request";
+      case 404: return "Not Found";
+      case 405: return "Method Not Allowed";
+      case 408: return "Request Timeout";
+      default:  return "Internal Server Error";
+    }
+  }
+
+  //
+  // sendAll
+  //
+  // Writes the whole buffer to the socket, retrying short writes.
+  //
+  static void sendAll(int fd, const string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+      ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+      if (n <= 0) {
+        return;
+      }
+      sent += n;
+    }
+  }
+
+  //
+  // record
+  //
+  // Adds the latency of one request to the metrics for its path.
+  //
+  void record(const string& path, int status, double us) {
+    lock_guard<mutex> guard(metricsLock);
+    pathMetrics& m = metrics[path];
+    m.count++;
+    if (status >= 400) {
+      m.errors++;
+    }
+    m.totalUs += us;
+    if (us > m.maxUs) {
+      m.maxUs = us;
+    }
+    int bucket = 0;
+    while (bucket < 31 && (1LL << bucket) <= us) {
+      bucket++;
+    }
+    m.buckets[bucket]++;
+  }
+
+  //
+  // percentile
+  //
+  // Upper bound (in microseconds) of the bucket holding the p-th
+  // percentile request, but no more than the slowest request seen.
+  //
+  static double percentile(const pathMetrics& m, double p) {
+    long long target = static_cast<long long>(p * m.count);
+    long long seen = 0;
+    for (int i = 0; i < 32; i++) {
+      seen += m.buckets[i];
+      if (seen > target) {
+        return min(static_cast<double>(1LL << i), m.maxUs);
+      }
+    }
+    return m.maxUs;
+  }
+
+  //
+  // readHeaders
+  //
+  // Reads the request line and headers (capped at 16 KB) into raw,
+  // waiting no longer than readTimeoutMs in total.  Returns false if the
+  // time ran out first.
+  //
+  bool readHeaders(int fd, string& raw) {
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(readTimeoutMs);
+    char buf[4096];
+    while (raw.find("\r\n\r\n") == string::npos && raw.size() < 16384) {
+      long long left = chrono::duration_cast<chrono::milliseconds>(
+          deadline - chrono::steady_clock::now()).count();
+      pollfd p;
+      p.fd = fd;
+      p.events = POLLIN;
+      p.revents = 0;
+      if (left <= 0 || poll(&p, 1, static_cast<int>(left)) <= 0) {
+        return false;
+      }
+      ssize_t n = recv(fd, buf, sizeof(buf), 0);
+      if (n <= 0) {
+        break;
+      }
+      raw.append(buf, n);
+    }
+    return true;
+  }
+
+  //
+  // handleConnection
+  //
+  // Reads one request from the client, dispatches it and closes the
+  // connection.  A client that runs out of time before its headers are
+  // in is closed (with a 408 if it sent part of a request), and one that
+  // closes without sending anything is just closed; neither is recorded.
+  // The latency recorded starts once the request is parsed, so it
+  // measures the server and not how slowly the client sent.
+  //
+  void handleConnection(int fd) {
+    timeval sendTimeout;
+    sendTimeout.tv_sec = HTTP_WRITE_TIMEOUT_MS / 1000;
+    sendTimeout.tv_usec = (HTTP_WRITE_TIMEOUT_MS % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &sendTimeout, sizeof(sendTimeout));
+
+    string raw;
+    bool complete = readHeaders(fd, raw);
+    if (!complete || raw.empty()) {
+      if (!raw.empty()) {
+        string body = "{\"error\":\"request timeout\"}";
+        sendAll(fd, "HTTP/1.1 408 Request Timeout\r\nContent-Type: application/json\r\n"
+                    "Content-Length: " + to_string(body.size()) +
+                    "\r\nConnection: close\r\n\r\n" + body);
+      }
+      close(fd);
+      return;
+    }
+
+    HttpRequest request;
+    HttpResponse response;
+    bool parsed = parseRequest(raw, request);
+    auto start = chrono::steady_clock::now();
+    if (!parsed) {
+      response.Status = 400;
+      response.Body = "{\"error\":\"bad request\"}";
+    } else if (request.Method != "GET") {
+      response.Status = 405;
+      response.Body = "{\"error\":\"only GET is supported\"}";
+    } else if (handlers.count(request.Path) == 0) {
+      response.Status = 404;
+      response.Body = "{\"error\":\"unknown path\"}";
+    } else {
+      try {
+        handlers.at(request.Path)(request, response);
+      } catch (exception& e) {
+        response.Status = 500;
+        response.Body = "{\"error\":\"internal error\"}";
+      }
+    }
+
+    double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    // Recorded before the response goes out, so a client that reads
+    // /metrics after its last reply always sees that request counted.
+    // Only registered paths get their own entry, so clients cannot grow
+    // the metrics table
+    record(handlers.count(request.Path) ? request.Path : string("(unknown)"),
+           response.Status, us);
+
+    string head = "HTTP/1.1 " + to_string(response.Status) + " " + statusText(response.Status) + "\r\n";
+    head += "Content-Type: " + response.ContentType + "\r\n";
+    head += "Content-Length: " + to_string(response.Body.size()) + "\r\n";
+    head += "X-Latency-Us: " + to_string(static_cast<long long>(us)) + "\r\n";
+    head += "Connection: close\r\n\r\n";
+    sendAll(fd, head);
+    sendAll(fd, response.Body);
+    close(fd);
+  }
+
+  void workerLoop() {
+    while (true) {
+      int fd;
+      {
+        unique_lock<mutex> lock(pendingLock);
+        pendingReady.wait(lock, [this]() { return !pending.empty() || !running; });
+        if (pending.empty()) {
+          return;
+        }
+        fd = pending.front();
+        pending.pop();
+      }
+      handleConnection(fd);
+    }
+  }
+
+ public:
+  //
+  // constructor:
+  //
+  // Creates a server for the given port (0 picks a free port) that
+  // serves requests on numThreads worker threads and gives each client
+  // readTimeoutMs to send its request.
+  //
+  httpserver(int port, int numThreads, int readTimeoutMs = HTTP_READ_TIMEOUT_MS) {
+    this->listenFd = -1;
+    this->portNum = port;
+    this->numThreads = (numThreads < 1) ? 1 : numThreads;
+    this->readTimeoutMs = (readTimeoutMs < 1) ? 1 : readTimeoutMs;
+    this->running = false;
+  }
+
+  ~httpserver() {
+    stop();
+  }
+
+  //
+  // route
+  //
+  // Registers the handler for requests to path.  Must be called
+  // before start().
+  //
+  void route(const string& path, HttpHandler handler) {
+    handlers[path] = handler;
+  }
+
+  //
+  // start
+  //
+  // Binds to 127.0.0.1 and starts the worker threads.  Returns false if
+  // the socket cannot be opened.
+  //
+  bool start() {
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+      return false;
+    }
+    int yes = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(portNum);
+    if (::bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        listen(listenFd, 128) < 0) {
+      close(listenFd);
+      listenFd = -1;
+      return false;
+    }
+
+    socklen_t len = sizeof(addr);
+    getsockname(listenFd, reinterpret_cast<sockaddr*>(&addr), &len);
+    portNum = ntohs(addr.sin_port);
+
+    running = true;
+    for (int i = 0; i < numThreads; i++) {
+      workers.emplace_back(&httpserver::workerLoop, this);
+    }
+    return true;
+  }
+
+  //
+  // run
+  //
+  // Accepts connections until stop() is called.
+  //
+  void run() {
+    while (running) {
+      int fd = accept(listenFd, nullptr, nullptr);
+      if (fd < 0) {
+        continue;
+      }
+      {
+        lock_guard<mutex> guard(pendingLock);
+        pending.push(fd);
+      }
+      pendingReady.notify_one();
+    }
+  }
+
+  //
+  // stop
+  //
+  // Stops accepting connections, finishes queued requests and joins
+  // the workers.
+  //
+  void stop() {
+    if (!running) {
+      return;
+    }
+    running = false;
+    shutdown(listenFd, SHUT_RDWR);
+    close(listenFd);
+    listenFd = -1;
+    pendingReady.notify_all();
+    for (auto& t : workers) {
+      t.join();
+    }
+    workers.clear();
+  }
+
+  int port() const {
+    return portNum;
+  }
+
+  //
+  // metricsJSON
+  //
+  // Returns the request count, error count and latency (mean, p50, p99,
+  // max in microseconds) of every path served so far.
+  //
+  string metricsJSON() const {
+    lock_guard<mutex> guard(metricsLock);
+    string out = "{";
+    bool first = true;
+    for (const auto& e : metrics) {
+      const pathMetrics& m = e.second;
+      char buf[256];
+      snprintf(buf, sizeof(buf),
+               "\"%s\":{\"count\":%lld,\"errors\":%lld,\"mean_us\":%.1f,"
+               "\"p50_us\":%.0f,\"p99_us\":%.0f,\"max_us\":%.1f}",
+               e.first.c_str(), m.count, m.errors,
+               m.count ? m.totalUs / m.count : 0.0,
+               percentile(m, 0.50), percentile(m, 0.99), m.maxUs);
+      if (!first) {
+        out += ',';
+      }
+      out += buf;
+      first = false;
+    }
+    out += "}";
+    return out;
+  }
+};
@@ -0,0 +1,156 @@
+// pathresult.h
+// Shayan Rasheed
+//
+// Path result with coordinates, and serializers that write it out
+//
+// University of Illinois at Chicago
+// CS 251: Fall 2021
+// Project #7 - Openstreet Maps
+//
+// All of the serializers append to a string that is reserved up front,
+// so a path with thousands of nodes is written with a single stream
+// write instead of one cout per node.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+
+#include "osm.h"
+
+using namespace std;
+
+//
+// PathResult
+//
+// A path from one node to another: the node ids in order, the
+// coordinates of each node, and the total distance in miles.
+//
+struct PathResult {
+  bool Reachable;
+  double Distance;
+  vector<long long> Nodes;
+  vector<Coordinates> Coords;
+
+  PathResult() {
+    Reachable = false;
+    Distance = 0;
+  }
+};
+
+//
+// appendNumber
+//
+// Appends a number to out using printf formatting, without going
+// through a stringstream.
+//
+inline void appendNumber(string& out, const char* format, double value) {
+  char buf[32];
+  int n = snprintf(buf, sizeof(buf), format, value);
+  out.append(buf, n);
+}
+
+//
+// appendPathIds
+//
+// Appends the node ids of the path as "id1->id2->...->idN".
+//
+inline void appendPathIds(const vector<long long>& path, string& out) {
+  // a footway node id is at most 19 digits, plus 2 for the arrow
+  out.reserve(out.size() + path.size() * 21);
+  for (size_t i = 0; i < path.size(); i++) {
+    if (i > 0) {
+      out += "->";
+    }
+    out += to_string(path[i]);
+  }
+}
+
+//
+// encodePolylineValue
+//
+// Encodes one coordinate delta using the Google encoded polyline
+// algorithm: zig-zag the value, then emit 5 bits per character.
+//
+inline void encodePolylineValue(long long value, string& out) {
+  unsigned long long v = (value < 0) ? ~(static_cast<unsigned long long>(value) << 1)
+                                     : (static_cast<unsigned long long>(value) << 1);
+  while (v >= 0x20) {
+    out += static_cast<char>((0x20 | (v & 0x1f)) + 63);
+    v >>= 5;
+  }
+  out += static_cast<char>(v + 63);
+}
+
+//
+// encodePolyline
+//
+// Appends the path's coordinates as an encoded polyline with 5
+// decimal places of precision (the format used by most map APIs).
+//
+inline void encodePolyline(const PathResult& path, string& out) {
+  // worst case is 6 characters per value, 2 values per point
+  out.reserve(out.size() + path.Coords.size() * 12);
+  long long prevLat = 0;
+  long long prevLon = 0;
+  for (const Coordinates& c : path.Coords) {
+    long long lat = llround(c.Lat * 1e5);
+    long long lon = llround(c.Lon * 1e5);
+    encodePolylineValue(lat - prevLat, out);
+    encodePolylineValue(lon - prevLon, out);
+    prevLat = lat;
+    prevLon = lon;
+  }
+}
+
+//
+// writeGeoJSON
+//
+// Appends the path as a GeoJSON Feature with a LineString geometry.
+// GeoJSON puts longitude before latitude.  The distance in miles and
+// the node ids are stored as properties.  A LineString needs two
+// positions, so a path of one node (start and end are the same) is a
+// Point, and a path with no nodes (unreachable) has a null geometry.
+//
+inline void writeGeoJSON(const PathResult& path, string& out) {
+  // ~28 characters per coordinate pair and ~21 per node id
+  out.reserve(out.size() + 128 + path.Coords.size() * 28 + path.Nodes.size() * 21);
+  out += "{\"type\":\"Feature\",\"geometry\":";
+  if (path.Coords.empty()) {
+    out += "null";
+  } else if (path.Coords.size() == 1) {
+    out += "{\"type\":\"Point\",\"coordinates\":[";
+    appendNumber(out, "%.7f", path.Coords[0].Lon);
+    out += ',';
+    appendNumber(out, "%.7f", path.Coords[0].Lat);
+    out += "]}";
+  } else {
+    out += "{\"type\":\"LineString\",\"coordinates\":[";
+    for (size_t i = 0; i < path.Coords.size(); i++) {
+      if (i > 0) {
+        out += ',';
+      }
+      out += '[';
+      appendNumber(out, "%.7f", path.Coords[i].Lon);
+      out += ',';
+      appendNumber(out, "%.7f", path.Coords[i].Lat);
+      out += ']';
+    }
+    out += "]}";
+  }
+  out += ",\"properties\":{\"reachable\":";
+  out += path.Reachable ? "true" : "false";
+  out += ",\"distance\":";
+  appendNumber(out, "%.8g", path.Distance);
+  out += ",\"nodes\":[";
+  for (size_t i = 0; i < path.Nodes.size(); i++) {
+    if (i > 0) {
+      out += ',';
+    }
+    out += to_string(path.Nodes[i]);
+  }
+  out += "]}}";
+}
@@ -0,0 +1,237 @@
+// servertest.cpp
+// Shayan Rasheed
+//
+// Local test client for server mode
+//
+// University of Illinois at Chicago
+// CS 251: Fall 2021
+// Project #7 - Openstreet Maps
+//
+// Start the server, then run the client against it:
+//   application.exe --serve map.osm 8080 2
+//   g++ -std=c++11 -Wall servertest.cpp -o servertest.exe
+//   servertest.exe [port] [from] [to] [idle]
+// from and to (default SEO and LCA) must be two buildings with a route
+// between them.  The client checks the status and body of /route,
+// /nearest and /metrics requests, good and bad, then opens idle
+// connections (default 4, at least as many as the server has workers)
+// and checks that a request still gets through and that the server
+// closes the idle ones.  The server drops each idle connection after
+// HTTP_READ_TIMEOUT_MS, so this part takes about that long times
+// idle / workers.  Each check prints a line; the exit status is 1 if
+// any failed.
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+using namespace std;
+
+// Server's read timeout (HTTP_READ_TIMEOUT_MS in httpserver.h)
+const int SERVER_TIMEOUT_S = 5;
+
+int port = 8080;
+int failures = 0;
+// Longest the client waits on a response or for an idle socket to be
+// closed: enough for every idle connection to time out on one worker
+int clientTimeoutS = 30;
+
+struct Reply {
+  int Status;  // 0 if the request failed
+  string Body;
+};
+
+// Function connectLocal:
+// Opens a connection to the server, or returns -1
+int connectLocal() {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  timeval timeout;
+  timeout.tv_sec = clientTimeoutS;
+  timeout.tv_usec = 0;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Function get:
+// Sends GET target and returns the status and body of the response
+Reply get(const string& target) {
+  Reply reply;
+  reply.Status = 0;
+  int fd = connectLocal();
+  if (fd < 0) {
+    return reply;
+  }
+  string request = "GET " + target + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+  if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) != (ssize_t) request.size()) {
+    close(fd);
+    return reply;
+  }
+  // The server closes the connection after the response
+  string raw;
+  char buf[4096];
+  ssize_t n;
+  while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+    raw.append(buf, n);
+  }
+  close(fd);
+
+  size_t headEnd = raw.find("\r\n\r\n");
+  if (raw.compare(0, 9, "HTTP/1.1 ") != 0 || headEnd == string::npos) {
+    return reply;
+  }
+  reply.Status = atoi(raw.c_str() + 9);
+  reply.Body = raw.substr(headEnd + 4);
+  return reply;
+}
+
+// Function check:
+// Prints the result of one check and counts the failures
+void check(bool ok, const string& what) {
+  cout << (ok ? "  ok    " : "  FAIL  ") << what << endl;
+  if (!ok) {
+    failures++;
+  }
+}
+
+// Function contains:
+// Returns true if the body contains text
+bool contains(const Reply& r, const string& text) {
+  return r.Body.find(text) != string::npos;
+}
+
+// Function jsonNumber:
+// Returns the number after "key": in the part of body starting at from
+double jsonNumber(const string& body, const string& key, size_t from) {
+  size_t pos = body.find("\"" + key + "\":", from);
+  if (pos == string::npos) {
+    return -1;
+  }
+  return atof(body.c_str() + pos + key.size() + 3);
+}
+
+// Function checkRequests:
+// Checks the answers to good and bad requests on each path
+void checkRequests(const string& from, const string& to) {
+  cout << "requests:" << endl;
+  Reply r = get("/route?from=" + from + "&to=" + to);
+  check(r.Status == 200 && contains(r, "\"LineString\"") && contains(r, "\"polyline\""),
+        "/route " + from + " to " + to + " is 200 with a LineString");
+  r = get("/route?from=" + from + "&to=" + from);
+  check(r.Status == 200 && contains(r, "\"Point\"") && !contains(r, "\"LineString\""),
+        "/route to the same building is 200 with a Point");
+  r = get("/route?from=" + from);
+  check(r.Status == 400 && contains(r, "\"error\""), "/route without to is 400");
+  r = get("/route?from=" + from + "&to=No%20Such%20Building%20Anywhere");
+  check(r.Status == 404 && contains(r, "\"error\""), "/route to an unknown building is 404");
+
+  r = get("/nearest?lat=41.87&lon=-87.65");
+  check(r.Status == 200 && contains(r, "\"building\"") && contains(r, "\"node\""),
+        "/nearest is 200 with a building");
+  r = get("/nearest?lat=north&lon=-87.65");
+  check(r.Status == 400 && contains(r, "\"error\""), "/nearest with a bad lat is 400");
+  r = get("/nearest");
+  check(r.Status == 400, "/nearest without lat and lon is 400");
+
+  r = get("/no/such/path");
+  check(r.Status == 404, "an unknown path is 404");
+}
+
+// Function checkMetrics:
+// Checks that /metrics counted the requests above and that no
+// percentile is over the path's max
+void checkMetrics() {
+  cout << "metrics:" << endl;
+  Reply r = get("/metrics");
+  check(r.Status == 200 && r.Body.size() > 1 && r.Body[0] == '{', "/metrics is 200 with JSON");
+  const char* paths[] = {"/route", "/nearest"};
+  for (const char* path : paths) {
+    size_t at = r.Body.find(string("\"") + path + "\":");
+    if (at == string::npos) {
+      check(false, string(path) + " is in /metrics");
+      continue;
+    }
+    double count = jsonNumber(r.Body, "count", at);
+    double errors = jsonNumber(r.Body, "errors", at);
+    double p50 = jsonNumber(r.Body, "p50_us", at);
+    double p99 = jsonNumber(r.Body, "p99_us", at);
+    double maxUs = jsonNumber(r.Body, "max_us", at);
+    check(count >= 3 && errors >= 1, string(path) + " counted its requests and errors");
+    // max_us has one decimal and the percentiles none
+    check(p50 <= p99 && p99 <= maxUs + 1, string(path) + " p50 <= p99 <= max");
+  }
+}
+
+// Function checkIdle:
+// Opens connections that never send anything, then checks that a
+// request still gets through and that the server closes them
+void checkIdle(int nIdle) {
+  cout << "idle connections:" << endl;
+  vector<int> idle;
+  for (int i = 0; i < nIdle; i++) {
+    int fd = connectLocal();
+    if (fd >= 0) {
+      idle.push_back(fd);
+    }
+  }
+  check(idle.size() == (size_t) nIdle, "opened " + to_string(nIdle) + " idle connections");
+
+  auto start = chrono::steady_clock::now();
+  Reply r = get("/metrics");
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  check(r.Status == 200, "/metrics answered behind them (after " + to_string(seconds) + " s)");
+
+  // A closed socket reads 0 bytes; a timeout here means it was kept open
+  int closed = 0;
+  for (int fd : idle) {
+    char c;
+    if (recv(fd, &c, 1, 0) == 0) {
+      closed++;
+    }
+    close(fd);
+  }
+  check(closed == (int) idle.size(),
+        "server closed " + to_string(closed) + " of " + to_string(idle.size()) + " idle connections");
+}
+
+int main(int argc, char* argv[]) {
+  port = (argc > 1) ? atoi(argv[1]) : 8080;
+  string from = (argc > 2) ? argv[2] : "SEO";
+  string to = (argc > 3) ? argv[3] : "LCA";
+  int nIdle = (argc > 4) ? max(1, atoi(argv[4])) : 4;
+  clientTimeoutS = SERVER_TIMEOUT_S * (nIdle + 1) + 10;
+
+  if (get("/metrics").Status != 200) {
+    cout << "**Error: no server on 127.0.0.1:" << port << endl;
+    return 1;
+  }
+  checkRequests(from, to);
+  checkMetrics();
+  checkIdle(nIdle);
+
+  cout << (failures == 0 ? "all checks passed" : to_string(failures) + " checks failed") << endl;
+  return failures == 0 ? 0 : 1;
+}
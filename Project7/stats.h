@@ -0,0 +1,153 @@
+// stats.h
+// Shayan Rasheed
+//
+// Counters and timers for the routing pipeline
+//
+// University of Illinois at Chicago
+// CS 251: Fall 2021
+// Project #7 - Openstreet Maps
+//
+// A RouteStats is filled in for each query (snap, search, unpack) and
+// then added into a run-wide total, which also holds the map load and
+// graph build times.  Counting is done in plain integers inside each
+// function and copied out once, so the cost per query is a handful of
+// clock reads.
+//
+
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <mutex>
+#include <cstdio>
+#include <iostream>
+
+using namespace std;
+
+struct RouteStats {
+  long long Queries;     // routes answered
+  long long Snaps;       // nearestNode calls
+  long long Searches;    // dijkstra calls
+  long long Settled;     // vertices removed from the queue and visited
+  long long Pushes;      // entries pushed onto the priority queue
+  long long StalePops;   // entries popped for already visited vertices
+  long long Relaxed;     // edges that lowered a distance
+  long long PathNodes;   // nodes on unpacked paths
+
+  double LoadMs;         // reading the map file
+  double BuildMs;        // building the graph
+  double SnapMs;         // nearestNode
+  double SearchMs;       // dijkstra
+  double UnpackMs;       // getPath / getPathResult
+
+  RouteStats() {
+    Queries = Snaps = Searches = Settled = Pushes = StalePops = Relaxed = PathNodes = 0;
+    LoadMs = BuildMs = SnapMs = SearchMs = UnpackMs = 0;
+  }
+
+  //
+  // add
+  //
+  // Adds the counters and times of other into this.
+  //
+  void add(const RouteStats& other) {
+    Queries += other.Queries;
+    Snaps += other.Snaps;
+    Searches += other.Searches;
+    Settled += other.Settled;
+    Pushes += other.Pushes;
+    StalePops += other.StalePops;
+    Relaxed += other.Relaxed;
+    PathNodes += other.PathNodes;
+    LoadMs += other.LoadMs;
+    BuildMs += other.BuildMs;
+    SnapMs += other.SnapMs;
+    SearchMs += other.SearchMs;
+    UnpackMs += other.UnpackMs;
+  }
+
+  //
+  // toJSON
+  //
+  // Returns the stats as a single-line JSON object.
+  //
+  string toJSON() const {
+    char buf[512];
+    snprintf(buf, sizeof(buf),
+             "{\"queries\":%lld,\"snaps\":%lld,\"searches\":%lld,"
+             "\"settled\":%lld,\"pushes\":%lld,\"stale_pops\":%lld,"
+             "\"relaxed\":%lld,\"path_nodes\":%lld,"
+             "\"load_ms\":%.3f,\"build_ms\":%.3f,\"snap_ms\":%.3f,"
+             "\"search_ms\":%.3f,\"unpack_ms\":%.3f}",
+             Queries, Snaps, Searches, Settled, Pushes, StalePops, Relaxed,
+             PathNodes, LoadMs, BuildMs, SnapMs, SearchMs, UnpackMs);
+    return buf;
+  }
+};
+
+//
+// statsTimer
+//
+// Adds the time between its construction and destruction (in ms) to
+// target.  A null target turns the timer off.
+//
+class statsTimer {
+ private:
+  double* target;
+  chrono::steady_clock::time_point start;
+
+ public:
+  explicit statsTimer(double* target) {
+    this->target = target;
+    if (target != nullptr) {
+      start = chrono::steady_clock::now();
+    }
+  }
+
+  ~statsTimer() {
+    if (target != nullptr) {
+      *target += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+  }
+};
+
+//
+// statsCollector
+//
+// Run-wide totals shared by every thread, plus the settings that say
+// whether stats are wanted at all and whether each query is printed.
+//
+class statsCollector {
+ private:
+  RouteStats total;
+  mutable mutex lock;
+
+ public:
+  bool Enabled;
+  bool PerQuery;
+
+  statsCollector() {
+    Enabled = false;
+    PerQuery = false;
+  }
+
+  //
+  // add
+  //
+  // Adds one query (or the load step) into the totals.  If PerQuery is
+  // set and id is not negative, the query's own stats are written to
+  // cerr as {"query":id,"stats":{...}}.
+  //
+  void add(const RouteStats& s, long long id) {
+    lock_guard<mutex> guard(lock);
+    total.add(s);
+    if (PerQuery && id >= 0) {
+      cerr << "{\"query\":" << id << ",\"stats\":" << s.toJSON() << "}\n";
+    }
+  }
+
+  RouteStats totals() const {
+    lock_guard<mutex> guard(lock);
+    return total;
+  }
+};